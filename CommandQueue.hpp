@@ -36,15 +36,1752 @@ dedicated to high speed function calls in just 6 CPU instructions!
 */
 
 #include <stdlib.h>
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
 
 #include <thread>
+#include <chrono>
 #include <atomic>
 #include <mutex>
 #include <condition_variable>
+#include <tuple>
+#include <new>
+#include <memory>
+#include <utility>
+#include <type_traits>
+#include <vector>
+#include <string>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#if defined(__linux__)
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+#if !defined(_MSC_VER)
+#include <pthread.h>
+#endif
+#if defined(COMMANDQUEUE_ENABLE_PROFILING)
+#include <algorithm>
+#if !defined(_MSC_VER)
+#include <dlfcn.h>
+#include <cxxabi.h>
+#endif
+#endif
 
 typedef void ( *PFNCommandHandler ) ( void* data );
 
-class CommandQueue
+
+//
+//		Command records																				//	Every command is a record: { stub, size } header + data section. The header is padded to 16 bytes (32 with COMMANDQUEUE_ENABLE_LATENCY), and every record starts on a COMMAND_ALIGNMENT boundary, so your parameters are never misaligned!
+//
+#ifndef COMMANDQUEUE_RECORD_ALIGNMENT
+#if defined(COMMANDQUEUE_ENABLE_LATENCY)
+#define COMMANDQUEUE_RECORD_ALIGNMENT 32																//	The header is 32 bytes with the enqueue time in it, see COMMAND_STAMP
+#else
+#define COMMANDQUEUE_RECORD_ALIGNMENT 16																//	#define COMMANDQUEUE_RECORD_ALIGNMENT 64 BEFORE you include this file, to start every command on its own cache line ... and for parameters like __m256 that need more than 16 bytes alignment!
+#endif
+#endif
+
+static const uint32_t COMMAND_ALIGNMENT = COMMANDQUEUE_RECORD_ALIGNMENT;
+#if defined(COMMANDQUEUE_ENABLE_LATENCY)
+static const uint32_t COMMAND_HEADER = 32;															//	{ stub, size } + the 64-bit enqueue time, rounded up to 32 ... only with COMMANDQUEUE_ENABLE_LATENCY, everybody else keeps the 16 byte header!
+static const uint32_t COMMAND_STAMP = 16;															//	steady_clock nanoseconds, a whole uint64_t, so a command can wait as long as it likes
+#else
+static const uint32_t COMMAND_HEADER = 16;															//	sizeof( PFNCommandHandler* ) + sizeof( uint32_t ), rounded up to 16
+#endif
+
+static_assert( COMMAND_ALIGNMENT >= COMMAND_HEADER && ( COMMAND_ALIGNMENT & ( COMMAND_ALIGNMENT - 1 ) ) == 0, "COMMANDQUEUE_RECORD_ALIGNMENT must be a power-of-two, and at least the header (16 bytes, 32 with COMMANDQUEUE_ENABLE_LATENCY)" );
+
+constexpr uint32_t commandSize( const uint32_t size )												//	Total size of a record with a `size` byte data section, the next record starts directly after it
+{
+	return ( COMMAND_HEADER + size + COMMAND_ALIGNMENT - 1 ) & ~( COMMAND_ALIGNMENT - 1 );
+}
+
+inline void* allocCommands( const size_t size )														//	malloc() only guarantees 8 or 16 bytes alignment, the command buffers need COMMAND_ALIGNMENT!
+{
+	#if defined(_MSC_VER)
+	return ::_aligned_malloc( size, COMMAND_ALIGNMENT );
+	#else
+	void* memory = nullptr;
+	return ::posix_memalign( &memory, COMMAND_ALIGNMENT, size ) == 0 ? memory : nullptr;
+	#endif
+}
+inline void freeCommands( void* memory )
+{
+	#if defined(_MSC_VER)
+	::_aligned_free( memory );
+	#else
+	::free( memory );
+	#endif
+}
+
+
+//
+//		Cache lines																					//	The producer side and the consumer side of every queue live on different cache lines, otherwise every execute() would steal the line the consumer thread is reading from (false sharing)!
+//
+#ifndef COMMANDQUEUE_CACHE_LINE
+#if defined(__cpp_lib_hardware_interference_size) && !defined(__GNUC__)								//	GCC warns about it in headers, the value can change with -mtune, so we don't trust it there
+#define COMMANDQUEUE_CACHE_LINE std::hardware_destructive_interference_size
+#else
+#define COMMANDQUEUE_CACHE_LINE 64																	//	x86 and most ARM cores ... #define COMMANDQUEUE_CACHE_LINE 128 for Apple M1+ (or to cover the adjacent line prefetcher on Intel)
+#endif
+#endif
+
+static const size_t CACHE_LINE = COMMANDQUEUE_CACHE_LINE;											//	Padding is a plain char array, NOT alignas(), so it also works when the queue is allocated with a C++11 `new` that ignores over-alignment!
+
+
+//
+//		Statistics																					//	#define COMMANDQUEUE_ENABLE_STATS BEFORE you include this file, for the counters below ... without it they don't exist at all, not one instruction or byte is added to the queue!
+//
+struct CommandQueueStats																			//	A snapshot, see stats() ... every counter is read on its own, so they can be a few commands apart from each other
+{
+	uint64_t				enqueued = 0;																//	Commands published by the producers ... always available, it's the ticket counter
+	uint64_t				executed = 0;																//	Commands executed by the command thread ... always available, it's the completed ticket
+	uint64_t				bytes = 0;																	//	Bytes reserved in the buffers, headers and padding included
+	uint64_t				drains = 0;																	//	Drains that executed at least one command
+	uint64_t				maxBatch = 0;																//	The most commands executed by one drain ... counted by ticket, so a command published DURING a drain can be counted in the next one
+	uint64_t				swaps = 0;																	//	Buffer swaps by the command thread, the empty ones too (DoubleBuffer, one per lane with StagingBuffers, the RingBackend never swaps)
+	uint64_t				grows = 0;																	//	A producer filled the buffer and allocated a bigger one (DoubleBuffer and StagingBuffers)
+	uint64_t				acquireSpins = 0;															//	Loops producers spent waiting for the buffer (or the ring lock), held by another producer or by the command thread swapping it
+	uint64_t				parks = 0;																	//	Times the command thread went to sleep, and somebody had to pay for waking it up!
+
+	double averageBatch() const { return this->drains ? ( double ) this->executed / this->drains : 0.0; }
+};
+
+#if defined(COMMANDQUEUE_ENABLE_STATS)
+#define COMMANDQUEUE_STAT( statement ) statement
+typedef std::atomic< uint64_t > stat_t;
+
+inline void statAdd( stat_t& counter, const uint64_t value )										//	Many writers, the producers
+{
+	counter.fetch_add( value, std::memory_order_relaxed );
+}
+inline void statOwn( stat_t& counter, const uint64_t value )										//	ONE writer (the command thread, or the producer holding the buffer), so no locked add ... still atomic, so stats() can read it from any thread
+{
+	counter.store( counter.load( std::memory_order_relaxed ) + value, std::memory_order_relaxed );
+}
+#else
+#define COMMANDQUEUE_STAT( statement )
+#endif
+
+
+//
+//		Memory policies																				//	Where the memory of a queue comes from ... the last template parameter of the backends! A policy is just a few static functions and a granularity, write your own if you need to!
+//
+inline void prefaultMemory( char* memory, const size_t size )										//	Touch every page, so the page faults (and the NUMA placement!) happen NOW, on the calling thread
+{
+	for ( size_t i = 0; i < size; i += 4096 )
+		( ( volatile char* ) memory )[ i ] = 0;
+}
+
+struct HeapMemory																					//	Aligned malloc() (default)
+{
+	static const uint32_t granularity = COMMAND_ALIGNMENT;
+
+	static void* allocate( const size_t size )						{ return allocCommands( size ); }	//	The command buffers, big and long lived
+	static void deallocate( void* memory, const size_t /* size */ )	{ freeCommands( memory ); }
+
+	static void* allocateNode( const size_t size )					{ return allocCommands( size ); }	//	Everything else, small and recycled: spilled buffers, lanes, future states and work-stealing tasks ... aligned to COMMAND_ALIGNMENT too
+	static void deallocateNode( void* memory, const size_t /* size */ )	{ freeCommands( memory ); }
+};
+
+template< bool Lock = false >																		//	Lock = true: mlock() the buffers too, so the drain loop can NEVER take a page fault, not even when the system is swapping! Needs `ulimit -l` (RLIMIT_MEMLOCK) big enough, otherwise it's skipped ... check locked()
+struct HugePageMemory : HeapMemory																	//	For BIG queues (64MB+) ... 2MB pages, so the drain loop doesn't thrash the TLB, and every page is faulted in up front, not on first touch in the middle of a burst! Nodes still come from the heap, a huge page for every future would be silly
+{
+	static const uint32_t granularity = 2 * 1024 * 1024;											//	Every buffer is rounded up to a whole number of huge pages, the DoubleBuffer uses the extra space instead of wasting it
+
+	static size_t pages( const size_t size ) { return ( size + granularity - 1 ) & ~( size_t ) ( granularity - 1 ); }
+
+	static std::atomic< uint32_t >& lockFailures()													//	Buffers that asked for mlock() and didn't get it
+	{
+		static std::atomic< uint32_t > failures { 0 };
+		return failures;
+	}
+	static bool locked() { return Lock && lockFailures().load( std::memory_order_relaxed ) == 0; }	//	true when Lock = true AND every buffer allocated so far is locked ... the buffers of all queues with this policy!
+
+	static void* allocate( const size_t size )
+	{
+		#if defined(_MSC_VER)																			//	Large pages on Windows need SeLockMemoryPrivilege, so we only pre-fault
+		char* memory = ( char* ) allocCommands( pages( size ) );
+		if ( memory )
+			prefaultMemory( memory, pages( size ) );
+		if ( Lock && memory )
+			lockFailures().fetch_add( 1, std::memory_order_relaxed );
+		return memory;
+		#else
+		void* memory = MAP_FAILED;
+		#if defined(MAP_HUGETLB) && defined(MAP_POPULATE)
+		memory = ::mmap( nullptr, pages( size ), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0 );	//	Explicit huge pages, pre-faulted NOW, not in the drain loop! Only works when the admin reserved some: /proc/sys/vm/nr_hugepages
+		#endif
+		if ( memory == MAP_FAILED )
+		{
+			memory = ::mmap( nullptr, pages( size ), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );	//	... otherwise ask for transparent huge pages, BEFORE we fault the pages in
+			if ( memory == MAP_FAILED )
+				return nullptr;
+			#if defined(MADV_HUGEPAGE)
+			::madvise( memory, pages( size ), MADV_HUGEPAGE );
+			#endif
+			prefaultMemory( ( char* ) memory, pages( size ) );
+		}
+		if ( Lock && ::mlock( memory, pages( size ) ) != 0 )
+			lockFailures().fetch_add( 1, std::memory_order_relaxed );
+		return memory;
+		#endif
+	}
+	static void deallocate( void* memory, const size_t size )
+	{
+		#if defined(_MSC_VER)
+		freeCommands( memory );
+		#else
+		if ( memory )
+			::munmap( memory, pages( size ) );															//	munmap() unlocks the pages too
+		#endif
+	}
+};
+
+template< typename TAllocator >																		//	Adapter for a std-style allocator (jemalloc arenas, a NUMA allocator, a counting allocator etc.) ... it's default constructed for every call, so a stateful allocator must find its arena by itself (template parameter, global, thread_local)
+struct AllocatorMemory
+{
+	typedef typename std::allocator_traits< TAllocator >::template rebind_alloc< char > allocator_t;
+	typedef std::allocator_traits< allocator_t > traits_t;
+
+	static const uint32_t granularity = COMMAND_ALIGNMENT;
+
+	static void* allocate( const size_t size )														//	The allocator only has to return bytes, so we over-allocate, align it ourselves, and keep the original pointer just in front of the aligned memory
+	{
+		allocator_t allocator;
+		char* memory = traits_t::allocate( allocator, size + COMMAND_ALIGNMENT + sizeof( char* ) );
+		char* aligned = ( char* ) ( ( ( uintptr_t ) memory + sizeof( char* ) + COMMAND_ALIGNMENT - 1 ) & ~( uintptr_t ) ( COMMAND_ALIGNMENT - 1 ) );
+		::memcpy( aligned - sizeof( char* ), &memory, sizeof( char* ) );
+		return aligned;
+	}
+	static void deallocate( void* memory, const size_t size )
+	{
+		if ( memory == nullptr )
+			return;
+		char* original;
+		::memcpy( &original, ( char* ) memory - sizeof( char* ), sizeof( char* ) );
+		allocator_t allocator;
+		traits_t::deallocate( allocator, original, size + COMMAND_ALIGNMENT + sizeof( char* ) );
+	}
+
+	static void* allocateNode( const size_t size )					{ return allocate( size ); }
+	static void deallocateNode( void* memory, const size_t size )	{ deallocate( memory, size ); }
+};
+
+
+//
+//		Timed commands																				//	COMMANDQUEUE_ENABLE_LATENCY and COMMANDQUEUE_ENABLE_PROFILING ... the command thread reads the clock after every command and records where the time went. Without them, none of this exists!
+//
+#if defined(COMMANDQUEUE_ENABLE_LATENCY) || defined(COMMANDQUEUE_ENABLE_PROFILING)
+#define COMMANDQUEUE_TIMED_COMMANDS
+
+static const uint32_t COMMAND_UNTIMED = 1;															//	Flags in the low bits of the record size, it's always a multiple of 16! Only the timed drain loop knows about them, it masks them off
+static const uint32_t COMMAND_KEYED = 2;															//	The data section starts with YOUR function pointer, the stub in the header is the same for every function with the same signature
+static const uint32_t COMMAND_FLAGS = COMMAND_HEADER - 1;
+
+inline uint64_t commandClock()																		//	Nanoseconds, steady_clock is a vDSO call on Linux (~20ns), no syscall
+{
+	return ( uint64_t ) std::chrono::duration_cast< std::chrono::nanoseconds >( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+#endif
+
+
+//
+//		Latency histograms																			//	#define COMMANDQUEUE_ENABLE_LATENCY BEFORE you include this file ... every command is stamped when it's written, and the command thread records how long it waited in the queue and how long it ran, see latency()
+//
+#if defined(COMMANDQUEUE_ENABLE_LATENCY)
+inline uint64_t latencyStamp()																		//	Written at COMMAND_STAMP when the command is written
+{
+	return commandClock();
+}
+
+class LatencyHistogram																				//	HDR style: 16 linear buckets for every power of two, so every value is within 6.25% ... ONE writer (the command thread), lock-free readers from any thread
+{
+	static const uint32_t	subBits = 4;
+	static const uint32_t	sub = 1 << subBits;
+	static const uint32_t	buckets = ( 64 - subBits + 1 ) * sub;										//	~8KB, the whole uint64_t range, no clamping
+
+	std::atomic< uint64_t >	counts[ buckets ];
+	std::atomic< uint64_t >	peak{ 0 };
+
+	static uint32_t highestBit( const uint64_t value )
+	{
+		#if defined(__GNUC__)
+		return 63 - __builtin_clzll( value );
+		#elif defined(_MSC_VER) && defined(_M_X64)
+		unsigned long index;
+		_BitScanReverse64( &index, value );
+		return index;
+		#else
+		uint32_t index = 0;
+		while ( value >> ( index + 1 ) )
+			index++;
+		return index;
+		#endif
+	}
+	static uint32_t bucket( const uint64_t value )
+	{
+		if ( value < sub )
+			return ( uint32_t ) value;
+		const uint32_t shift = highestBit( value ) - subBits;
+		return ( shift + 1 ) * sub + ( uint32_t ) ( value >> shift ) - sub;
+	}
+	static uint64_t highest( const uint32_t bucket )													//	The biggest value that lands in `bucket`, percentiles never look better than they are!
+	{
+		if ( bucket < sub )
+			return bucket;
+		const uint32_t shift = bucket / sub - 1;
+		return ( ( uint64_t ) ( bucket % sub + sub ) << shift ) + ( ( uint64_t ) 1 << shift ) - 1;
+	}
+
+public:
+	LatencyHistogram()
+	{
+		for ( uint32_t i = 0; i < buckets; i++ )
+			this->counts[ i ].store( 0, std::memory_order_relaxed );
+	}
+
+	void record( const uint64_t nanoseconds )															//	Command thread ONLY! A plain load + store, no locked instructions
+	{
+		std::atomic< uint64_t >& count = this->counts[ bucket( nanoseconds ) ];
+		count.store( count.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+		if ( nanoseconds > this->peak.load( std::memory_order_relaxed ) )
+			this->peak.store( nanoseconds, std::memory_order_relaxed );
+	}
+
+	uint64_t count() const
+	{
+		uint64_t total = 0;
+		for ( uint32_t i = 0; i < buckets; i++ )
+			total += this->counts[ i ].load( std::memory_order_relaxed );
+		return total;
+	}
+	uint64_t maximum() const																			//	Exact, not rounded to a bucket
+	{
+		return this->peak.load( std::memory_order_relaxed );
+	}
+	uint64_t percentile( const double p ) const															//	p = 0.5, 0.99, 0.999 ... in nanoseconds, 0 when nothing was recorded yet
+	{
+		uint64_t snapshot[ buckets ];																	//	The command thread keeps counting while we look, so take one copy and work on that
+		uint64_t total = 0;
+		for ( uint32_t i = 0; i < buckets; i++ )
+			total += snapshot[ i ] = this->counts[ i ].load( std::memory_order_relaxed );
+		if ( total == 0 )
+			return 0;
+
+		uint64_t rank = ( uint64_t ) ( p * total );														//	The p * total'th smallest value, rounded up
+		if ( rank == 0 || rank < p * total )
+			rank++;
+		uint64_t seen = 0;
+		for ( uint32_t i = 0; i < buckets; i++ )
+			if ( ( seen += snapshot[ i ] ) >= rank )
+				return highest( i ) < this->maximum() ? highest( i ) : this->maximum();
+		return this->maximum();
+	}
+};
+
+struct LatencyPercentiles																			//	Nanoseconds
+{
+	uint64_t				count = 0;
+	uint64_t				p50 = 0;
+	uint64_t				p99 = 0;
+	uint64_t				p999 = 0;
+	uint64_t				maximum = 0;																//	Not `max`, that's a macro when you include <windows.h>!
+
+	LatencyPercentiles() {}
+	LatencyPercentiles( const LatencyHistogram& histogram ) : count( histogram.count() ), p50( histogram.percentile( 0.5 ) ), p99( histogram.percentile( 0.99 ) ), p999( histogram.percentile( 0.999 ) ), maximum( histogram.maximum() ) {}
+};
+
+struct CommandQueueLatency
+{
+	LatencyPercentiles		queued;																		//	From execute() (the moment the command was written) until the command thread started it
+	LatencyPercentiles		executed;																	//	How long your function ran
+};
+
+#endif
+
+
+//
+//		Handler profiles																			//	#define COMMANDQUEUE_ENABLE_PROFILING BEFORE you include this file ... call count, total and max time of every function you execute(), see profile() and printProfile()
+//
+#if defined(COMMANDQUEUE_ENABLE_PROFILING)
+struct HandlerStats
+{
+	uintptr_t				handler = 0;																//	Your function pointer ... or the stub of a lambda / functor / rawExecute() function, there is no other pointer to it. 0 = everything that didn't fit in the table
+	uint64_t				calls = 0;
+	uint64_t				nanoseconds = 0;															//	Total
+	uint64_t				maximum = 0;
+
+	std::string name() const																		//	Symbol name, demangled ... needs -rdynamic for functions in the executable, otherwise you get "module+offset" for addr2line
+	{
+		if ( this->handler == 0 )
+			return "(other)";
+		char text[ 64 ];
+		#if !defined(_MSC_VER)
+		Dl_info info = {};
+		if ( ::dladdr( ( void* ) this->handler, &info ) != 0 )											//	0 = not in any module, and then info is NOT filled in
+		{
+			if ( info.dli_sname )
+			{
+				int status = 0;
+				char* demangled = abi::__cxa_demangle( info.dli_sname, nullptr, nullptr, &status );
+				std::string result = status == 0 && demangled ? demangled : info.dli_sname;
+				::free( demangled );
+				return result;
+			}
+			if ( info.dli_fname )
+			{
+				const char* module = ::strrchr( info.dli_fname, '/' );
+				::snprintf( text, sizeof( text ), "+0x%llx", ( unsigned long long ) ( this->handler - ( uintptr_t ) info.dli_fbase ) );
+				return std::string( module ? module + 1 : info.dli_fname ) + text;
+			}
+		}
+		#endif
+		::snprintf( text, sizeof( text ), "0x%llx", ( unsigned long long ) this->handler );
+		return text;
+	}
+};
+
+class HandlerProfile																				//	A fixed size open addressing table, keyed by the function pointer ... ONE writer (the command thread), no locks and no allocations, lock-free readers from any thread
+{
+	static const uint32_t	capacity = 1024;															//	Different handlers, not calls! ~32KB
+	static const uint32_t	probes = 16;
+
+	struct entry_t
+	{
+		std::atomic< uintptr_t > handler{ 0 };
+		std::atomic< uint64_t >	calls{ 0 };
+		std::atomic< uint64_t >	nanoseconds{ 0 };
+		std::atomic< uint64_t >	maximum{ 0 };
+	};
+	entry_t					entries[ capacity ];
+	entry_t					other;																		//	The table is full, or too many collisions ... still counted, just not by name
+
+	static void add( entry_t& entry, const uint64_t nanoseconds )
+	{
+		entry.calls.store( entry.calls.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+		entry.nanoseconds.store( entry.nanoseconds.load( std::memory_order_relaxed ) + nanoseconds, std::memory_order_relaxed );
+		if ( nanoseconds > entry.maximum.load( std::memory_order_relaxed ) )
+			entry.maximum.store( nanoseconds, std::memory_order_relaxed );
+	}
+	static HandlerStats read( const entry_t& entry, const uintptr_t handler )
+	{
+		HandlerStats result;
+		result.handler = handler;
+		result.calls = entry.calls.load( std::memory_order_relaxed );
+		result.nanoseconds = entry.nanoseconds.load( std::memory_order_relaxed );
+		result.maximum = entry.maximum.load( std::memory_order_relaxed );
+		return result;
+	}
+
+public:
+	void record( const uintptr_t handler, const uint64_t nanoseconds )								//	Command thread ONLY!
+	{
+		uint32_t index = ( uint32_t ) ( ( handler * 0x9E3779B97F4A7C15ull ) >> 32 ) & ( capacity - 1 );
+		for ( uint32_t probe = 0; probe < probes; probe++, index = ( index + 1 ) & ( capacity - 1 ) )
+		{
+			entry_t& entry = this->entries[ index ];
+			const uintptr_t key = entry.handler.load( std::memory_order_relaxed );
+			if ( key == 0 )
+				entry.handler.store( handler, std::memory_order_relaxed );							//	Claim the slot, nobody else writes to the table
+			else if ( key != handler )
+				continue;
+			add( entry, nanoseconds );
+			return;
+		}
+		add( this->other, nanoseconds );
+	}
+
+	std::vector< HandlerStats > snapshot() const														//	Most total time first
+	{
+		std::vector< HandlerStats > result;
+		for ( uint32_t i = 0; i < capacity; i++ )
+			if ( const uintptr_t handler = this->entries[ i ].handler.load( std::memory_order_relaxed ) )
+				result.push_back( read( this->entries[ i ], handler ) );
+		if ( this->other.calls.load( std::memory_order_relaxed ) )
+			result.push_back( read( this->other, 0 ) );
+		std::sort( result.begin(), result.end(), [] ( const HandlerStats& a, const HandlerStats& b ) { return a.nanoseconds > b.nanoseconds; } );
+		return result;
+	}
+};
+#endif
+
+
+//
+//		executeTimedCommands()																		//	executeCommands() + ONE clock read per command, the end of one command is the start of the next
+//
+#if defined(COMMANDQUEUE_TIMED_COMMANDS)
+struct command_recorder_t
+{
+	#if defined(COMMANDQUEUE_ENABLE_LATENCY)
+	LatencyHistogram		queued;
+	LatencyHistogram		executed;
+	#endif
+	#if defined(COMMANDQUEUE_ENABLE_PROFILING)
+	HandlerProfile			handlers;
+	#endif
+};
+inline command_recorder_t*& commandRecorder()														//	Set once by every command thread, so executeCommands() knows where to record ... nullptr on any other thread (the work-stealing pool), those commands aren't timed
+{
+	static thread_local command_recorder_t* recorder = nullptr;
+	return recorder;
+}
+
+inline void executeTimedCommands( char* base_addr, const char* end, command_recorder_t& recorder )
+{
+	uint64_t start = commandClock();
+	do
+	{
+		const uint32_t size = *( uint32_t* ) ( base_addr + sizeof( PFNCommandHandler* ) );
+		#if defined(COMMANDQUEUE_ENABLE_LATENCY)
+		const uint64_t stamp = *( uint64_t* ) ( base_addr + COMMAND_STAMP );
+		#endif
+		#if defined(COMMANDQUEUE_ENABLE_PROFILING)
+		const uintptr_t handler = ( size & COMMAND_KEYED ) ? *( uintptr_t* ) ( base_addr + COMMAND_HEADER ) : ( uintptr_t ) *( PFNCommandHandler* ) base_addr;	//	BEFORE the call, the stub destroys the parameters!
+		#endif
+		( *( PFNCommandHandler* ) base_addr )( base_addr + COMMAND_HEADER );
+		const uint64_t done = commandClock();
+		if ( !( size & COMMAND_UNTIMED ) )
+		{
+			#if defined(COMMANDQUEUE_ENABLE_LATENCY)
+			recorder.queued.record( start - stamp );
+			recorder.executed.record( done - start );
+			#endif
+			#if defined(COMMANDQUEUE_ENABLE_PROFILING)
+			recorder.handlers.record( handler, done - start );
+			#endif
+		}
+		start = done;
+		base_addr += size & ~COMMAND_FLAGS;
+	}
+	while ( base_addr < end );
+}
+#endif
+
+
+//
+//		executeCommands()																			//	Shared by all the buffer backends! Executes every command between `base_addr` and `end`, the backends only decide WHERE the commands are stored and how they are handed over to the consumer thread!
+//
+inline void executeCommands( char* base_addr, const char* end )
+{
+	#if defined(COMMANDQUEUE_TIMED_COMMANDS)
+	if ( command_recorder_t* recorder = commandRecorder() )											//	Only the command thread of a queue has one, and its records can have flags in the size ... see COMMAND_UNTIMED
+		return executeTimedCommands( base_addr, end, *recorder );
+	#endif
+	do																												//	The inner loop - 6 CPU instructions (VS2015 Release build) for the do..while()! This is the loop that actually makes the function calls! Each `command` (function pointer + data) is VARIABLE in length, depending on the number of parameters! So I don't used a fixed structure or std::queue, I do everything the old-school way, with direct pointers!
+	{
+		( *( PFNCommandHandler* ) base_addr )( base_addr + COMMAND_HEADER );		//	I know this might look like a train-wreck, but it's actually the heart and soul of this class! The inner loop! You know we always say, you should just optimize the inner-loops! The code that requires the maximum speed! Well, this is it! 6 CPU instructions in total to execute an entire queue of function calls! You don't get much faster than that! You cannot do this faster with ANY STL container! This is what low level C/C++ and Assembler knowledge gets you! Incredible speed!
+		base_addr += ( *( uint32_t* ) ( base_addr + sizeof( PFNCommandHandler* ) ) );								//	Calculate address of next function ... I guess this would be the equivalent of a queue `pop`. What we are doing is accessing the `size` value directly with a pointer. After the initial function pointer address (stored at the beginning of the `base_address`), there is a 32-bit offset number to the next function call. We just add this number to base_address to jump ahead to the next function call! There is no real `popping` of the data, that would be too slow and completely unecessary! We just make the function calls and recycle the buffer!
+	}
+	while ( base_addr < end );																						//	do while we haven't reached the end!
+}
+
+
+//
+//		OverflowPolicy																				//	What execute() does when a bounded queue (RingBackend) is full ... try_execute() NEVER waits, it just returns false!
+//
+enum class OverflowPolicy
+{
+	Block,																							//	Put the producer thread to sleep until the consumer thread makes some space (default) ... the producers waiting for the ring lock sleep too. NOTE: A command can NEVER wait for its own queue, a command that adds to its own full ring is dropped (and counted), whatever the policy!
+	Spin,																							//	Spin with backoff, for latency critical producers that have a core to burn
+	Drop																							//	Throw away the NEWEST command (the one we are trying to add), and count it ... see dropped()
+};
+
+enum class Reserve																					//	Passed to the backend reserve() functions, what to do when a bounded queue is full
+{
+	Policy,																							//	Apply the OverflowPolicy of the queue ... execute(), returns(), rawExecute()
+	Fail,																							//	Return nullptr immediately ... try_execute()
+	Wait																							//	Always wait, even with OverflowPolicy::Drop ... for commands that must NEVER be lost, like async()
+};
+
+
+//
+//		Wait strategies																				//	What the consumer thread does when the queue is empty ... the second template parameter of BasicCommandQueue! First it spins, then it yields its time slice, then it parks (sleeps)
+//
+struct BusySpin																						//	NEVER sleeps and never gives up the core ... lowest latency, but it burns 100% of a core, so only use it on a dedicated (isolated) core! Producers never have to wake it up!
+{
+	static const uint32_t	spins	= 0xFFFFFFFF;
+	static const uint32_t	yields	= 0;
+	static const bool		park	= false;
+	static const bool		notifyAlways = false;
+};
+struct SpinYield																					//	Spins for a moment, then std::this_thread::yield() forever ... other threads can use the core, but it never sleeps, so producers never have to wake it up!
+{
+	static const uint32_t	spins	= 1000;
+	static const uint32_t	yields	= 0xFFFFFFFF;
+	static const bool		park	= false;
+	static const bool		notifyAlways = false;
+};
+struct SpinPark																						//	Spins, yields, then sleeps on a condition variable (a futex on Linux) ... producers only notify when the consumer is actually parked! (default)
+{
+	static const uint32_t	spins	= 1000;
+	static const uint32_t	yields	= 100;
+	static const bool		park	= true;
+	static const bool		notifyAlways = false;
+};
+struct Blocking																						//	The original behaviour: sleeps as soon as the queue is empty, and producers lock + notify after EVERY command, even when the consumer is wide awake! Mostly here for benchmarking
+{
+	static const uint32_t	spins	= 0;
+	static const uint32_t	yields	= 0;
+	static const bool		park	= true;
+	static const bool		notifyAlways = true;
+};
+
+enum class ConsumerState : uint32_t																	//	What the consumer thread is doing right now, see consumerState()
+{
+	Draining,																						//	Executing commands
+	Spinning,																						//	Found nothing to do, spinning/yielding for a moment before it parks
+	Parked																							//	Asleep on the condition variable ... the ONLY state in which producers have to wake it up!
+};
+
+
+//
+//		cpuRelax()																					//	The `pause` instruction in a spin loop, it tells the CPU we are spinning, saves power and gives the other hyper-thread the core!
+//
+inline void cpuRelax()
+{
+	#if defined(_MSC_VER) && ( defined(_M_X64) || defined(_M_IX86) )
+	_mm_pause();
+	#elif defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+	__builtin_ia32_pause();
+	#elif defined(__GNUC__) && defined(__aarch64__)
+	asm volatile( "yield" );
+	#endif
+}
+
+
+//
+//		SharedTickets																				//	ONE issued/completed pair for the whole backend, the BasicDoubleBuffer and the RingBackend derive from it. Their producers already take turns on `primary` (or the ring lock), so one more counter costs them nothing new!
+//
+class SharedTickets
+{
+protected:
+	std::atomic< uint64_t >	issued{ 0 };																//	Producer side! The number of commands published so far, which is also the ticket of the last one
+	#if defined(COMMANDQUEUE_ENABLE_STATS)
+	stat_t					bytes{ 0 };																	//	Same cache line as `issued`, the producers already own it
+	#endif
+	char					padIssued[ CACHE_LINE ];
+	std::atomic< uint64_t >	completed{ 0 };																//	Consumer side! Every ticket <= completed has been executed
+	char					padCompleted[ CACHE_LINE ];
+
+	uint64_t complete( const uint64_t ticket )															//	Command thread! Publishes `ticket` (loaded BEFORE the drain took its buffer), returns the number of commands it completed
+	{
+		const uint64_t previous = this->completed.load( std::memory_order_relaxed );
+		if ( ticket != previous )
+			this->completed.store( ticket );															//	seq_cst! Either BasicCommandQueue::drain() sees `ticketWaiters`, or wait_until() sees the new ticket ... never neither!
+		return ticket - previous;
+	}
+
+public:
+	template< typename THandle >
+	uint64_t publish( THandle, const uint32_t commands )												//	AFTER release()! So when the command thread sees this ticket, it also sees the commands
+	{
+		return this->issued.fetch_add( commands ) + commands;
+	}
+	uint64_t publishOwn( const uint32_t commands )														//	publish() for ONE writer, see BasicStagingBuffers ... no locked add, and nobody else writes the line
+	{
+		const uint64_t ticket = this->issued.load( std::memory_order_relaxed ) + commands;
+		this->issued.store( ticket, std::memory_order_release );
+		return ticket;
+	}
+
+	uint64_t ticket()
+	{
+		return this->issued.load();
+	}
+	bool executed( const uint64_t ticket )
+	{
+		return this->completed.load() >= ticket;														//	seq_cst! See complete()
+	}
+	template< typename F >
+	bool tickets( F&& wait )																			//	join() ... calls `wait` with the ticket of everything published so far
+	{
+		return wait( this->ticket() );
+	}
+	uint64_t pending()
+	{
+		const uint64_t completed = this->completed.load( std::memory_order_relaxed );					//	completed FIRST, then it can never be ahead of issued
+		return this->issued.load( std::memory_order_relaxed ) - completed;
+	}
+	void progress( CommandQueueStats& result )														//	Adds, so the StagingBuffers can sum up their lanes
+	{
+		const uint64_t completed = this->completed.load( std::memory_order_relaxed );					//	executed FIRST, then it's never more than enqueued
+		result.executed += completed;
+		result.enqueued += this->issued.load( std::memory_order_relaxed );
+		#if defined(COMMANDQUEUE_ENABLE_STATS)
+		result.bytes += this->bytes.load( std::memory_order_relaxed );
+		#endif
+	}
+	#if defined(COMMANDQUEUE_ENABLE_STATS)
+	template< typename THandle >
+	void countBytes( THandle, const uint32_t reserved )
+	{
+		statAdd( this->bytes, reserved );
+	}
+	void countOwn( const uint32_t reserved )
+	{
+		statOwn( this->bytes, reserved );
+	}
+	#endif
+};
+
+
+//
+//		BasicDoubleBuffer																			//	The original lock-free double buffered queue! All producers share the `primary` buffer, the consumer thread swaps it with the `secondary` buffer. This is the default backend!
+//
+template< typename TMemory = HeapMemory >															//	TMemory = HeapMemory (default) or HugePageMemory<> ... see Memory policies
+class BasicDoubleBuffer : public SharedTickets
+{
+public:
+	struct spill_t																						//	A full buffer that was replaced by a bigger one, waiting to be executed by the consumer thread!
+	{
+		char*				commands;
+		uint32_t			size;
+		uint32_t			used;
+		spill_t*			next;
+	};
+	struct queue_buffer_t
+	{
+		char*				commands;
+		uint32_t			size;
+		uint32_t			used;
+		spill_t*			spilled;																	//	Oldest first! Usually nullptr, only used while the buffer is growing
+		#if defined(COMMANDQUEUE_ENABLE_STATS)
+		stat_t				grows{ 0 };
+		#endif
+		char				padding[ CACHE_LINE ];														//	buffer[ 0 ] is written by a producer while the consumer is executing buffer[ 1 ] ... don't let them share a cache line!
+	};
+	typedef queue_buffer_t* handle_t;
+	typedef TMemory memory_t;
+
+	static const uint32_t maxCommand = 0x40000000;													//	The biggest record, the buffer doubles until it fits ... see grow()
+
+protected:
+	queue_buffer_t			buffer[ 2 ];
+
+	std::atomic< queue_buffer_t* > primary	 { &buffer[ 0 ] };											//	Producer side! Every acquire()/release() pair writes it
+	#if defined(COMMANDQUEUE_ENABLE_STATS)
+	stat_t					acquireSpins{ 0 };
+	#endif
+	char					padPrimary[ CACHE_LINE ];
+
+	std::atomic< queue_buffer_t* > secondary { nullptr };												//	Consumer side! Only written by a producer on the `edge` case of swopping the buffers
+	queue_buffer_t*			consumer = &buffer[ 1 ];												//	The buffer currently owned by the consumer thread, it starts off with the `secondary` buffer!
+	#if defined(COMMANDQUEUE_ENABLE_STATS)
+	stat_t					swaps{ 0 };
+	#endif
+	char					padConsumer[ CACHE_LINE ];
+
+public:
+	~BasicDoubleBuffer()
+	{
+		TMemory::deallocate( this->buffer[ 0 ].commands, this->buffer[ 0 ].size );
+		TMemory::deallocate( this->buffer[ 1 ].commands, this->buffer[ 1 ].size );
+	}
+
+
+	//
+	//		init()
+	//
+	void init( uint32_t size )
+	{
+		size = ( size + TMemory::granularity - 1 ) & ~( TMemory::granularity - 1 );					//	Use ALL the memory we get, a huge page is 2MB no matter what you asked for!
+
+		this->buffer[ 0 ].commands = ( char* ) TMemory::allocate( size );
+		this->buffer[ 1 ].commands = ( char* ) TMemory::allocate( size );
+
+		this->buffer[ 0 ].size = size;
+		this->buffer[ 1 ].size = size;
+
+		this->buffer[ 0 ].used = 0;
+		this->buffer[ 1 ].used = 0;
+
+		this->buffer[ 0 ].spilled = nullptr;
+		this->buffer[ 1 ].spilled = nullptr;
+	}
+	//
+	//		prefault()																					//	Called right after init() on the consumer thread, when you asked for a NUMA node or pinned it to CPUs ... the pages land on the node of the thread that touches them first!
+	//
+	void prefault()
+	{
+		prefaultMemory( this->buffer[ 0 ].commands, this->buffer[ 0 ].size );
+		prefaultMemory( this->buffer[ 1 ].commands, this->buffer[ 1 ].size );
+	}
+
+
+	//
+	//		acquire()
+	//
+	queue_buffer_t* acquire()
+	{
+		queue_buffer_t* result;
+		COMMANDQUEUE_STAT( uint64_t spins = 0 );
+		while ( ( result = primary.exchange( nullptr ) ) == nullptr )
+			//	::Sleep( 0 );																			//	optional ... there are 2 producers fighting for the buffer, but they acquire and release very quickly, within a few clock cycles, it's less efficient to sleep!
+			COMMANDQUEUE_STAT( spins++ );
+		COMMANDQUEUE_STAT( if ( spins ) statAdd( this->acquireSpins, spins ) );
+		return result;
+	}
+	//
+	//		release()
+	//
+	void release( queue_buffer_t* buffer )
+	{
+		queue_buffer_t* exp = nullptr;
+		if ( !primary.compare_exchange_strong( exp, buffer ) )
+			secondary = buffer;																			//	Because we use Double Buffers, one is in primary, so put the other in secondary! Actually, there is a very important reason why we do this, if you are clever enough you will realise it! The thread is actually waiting for us to write this in a special while loop, look carefully! This is the second `edge` case of swopping the buffers! It's brilliant!
+	}
+
+
+	//
+	//		reserve()
+	//
+	static char* reserve( queue_buffer_t* buffer, uint32_t& reserved, const Reserve /* mode */ = Reserve::Policy )	//	reserves `reserved` bytes at the end of the buffer, returns the base address of the new command. The buffer just grows, so it never has to wait and never fails!
+	{
+		if ( buffer->used + reserved > buffer->size )													//	check if we need to resize the buffer
+			grow( buffer, reserved );
+
+		const uint32_t base = buffer->used;																//	store base address of this command, it's an array index into a char* buffer
+		buffer->used += reserved;
+		return &buffer->commands[ base ];
+	}
+
+
+	//
+	//		grow()																						//	We can NOT realloc() the buffer, the parameters might be objects (std::string etc.) that point into themselves! So the full buffer is `spilled`, and executed by the consumer before the new one!
+	//
+	static void grow( queue_buffer_t* buffer, const uint32_t reserved )
+	{
+		const uint32_t size = buffer->size;
+		COMMANDQUEUE_STAT( statOwn( buffer->grows, 1 ) );
+		do buffer->size *= 2;																			//	multiply size by *= 2, keep checking to make sure we have enough space for everything!
+		while ( buffer->used + reserved > buffer->size );
+
+		if ( buffer->used )
+		{
+			spill_t* spill = ( spill_t* ) TMemory::allocateNode( sizeof( spill_t ) );
+			spill->commands = buffer->commands;
+			spill->size = size;
+			spill->used = buffer->used;
+			spill->next = nullptr;
+
+			spill_t** tail = &buffer->spilled;
+			while ( *tail )
+				tail = &( *tail )->next;
+			*tail = spill;
+		}
+		else
+			TMemory::deallocate( buffer->commands, size );
+
+		buffer->commands = ( char* ) TMemory::allocate( buffer->size );											//	the new buffer, we will re-use this buffer, I feel if you needed a buffer this big before, it's likely you'll need it again! So I NEVER reduce the size of the buffer! This is up to you!
+		buffer->used = 0;
+	}
+
+
+	//
+	//		drain()																						//	Called by the consumer thread ONLY! Swaps the buffers and executes everything in the buffer we got back, returns false when there was nothing to do! Adds the commands whose tickets it completed to `finished`
+	//
+	bool drain( uint64_t& finished )
+	{
+		const uint64_t ticket = this->issued.load( std::memory_order_acquire );						//	BEFORE we take the buffer! Every ticket up to here was released, so its commands are in this buffer (or an earlier one)
+		queue_buffer_t* buffer = primary.exchange( this->consumer );
+
+		while ( buffer == nullptr )
+			buffer = secondary.exchange( nullptr );
+
+		this->consumer = buffer;
+		COMMANDQUEUE_STAT( statOwn( this->swaps, 1 ) );
+
+		if ( buffer->used == 0 )
+		{
+			finished += this->complete( ticket );														//	The commands were executed by the last drain, before their producer published the ticket
+			return false;
+		}
+
+		while ( buffer->spilled )																		//	The smaller buffers that filled up before this one, they are freed after executing, only the biggest buffer is kept!
+		{
+			spill_t* spill = buffer->spilled;
+			executeCommands( spill->commands, spill->commands + spill->used );
+			buffer->spilled = spill->next;
+			TMemory::deallocate( spill->commands, spill->size );
+			TMemory::deallocateNode( spill, sizeof( spill_t ) );
+		}
+
+		executeCommands( buffer->commands, buffer->commands + buffer->used );
+		buffer->used = 0;																				//	This essentially allows the buffer to be recycled! After this, this current buffer is exchanged with the `front-facing` / active buffer. So the `front-facing` / active is essentially a reset buffer with this. `used` is just an offset, and we just basically reset it to the beginning!
+		finished += this->complete( ticket );
+		return true;
+	}
+
+
+	void printBufferSizes()
+	{
+		printf( "Double Buffer sizes: %d KB + %d KB\n", this->buffer[ 0 ].size / 1024, this->buffer[ 1 ].size / 1024 );
+	}
+	#if defined(COMMANDQUEUE_ENABLE_STATS)
+	void stats( CommandQueueStats& result )															//	Adds, so the StagingBuffers can sum up their lanes
+	{
+		result.swaps += this->swaps.load( std::memory_order_relaxed );
+		result.grows += this->buffer[ 0 ].grows.load( std::memory_order_relaxed ) + this->buffer[ 1 ].grows.load( std::memory_order_relaxed );
+		result.acquireSpins += this->acquireSpins.load( std::memory_order_relaxed );
+	}
+	#endif
+};
+typedef BasicDoubleBuffer<> DoubleBuffer;
+
+
+//
+//		lane_owner_t																				//	One per producer thread, shared by the lanes it owns in every StagingBuffers queue ... it outlives the thread, so the queue can see that the thread is gone and hand its lane to a new one!
+//
+struct lane_owner_t
+{
+	std::atomic< bool >		alive{ true };
+	std::atomic< uint32_t >	refs{ 1 };																	//	The thread + every lane it owns
+
+	void retain()
+	{
+		this->refs.fetch_add( 1, std::memory_order_relaxed );
+	}
+	void release()
+	{
+		if ( this->refs.fetch_sub( 1, std::memory_order_acq_rel ) == 1 )
+			delete this;
+	}
+
+	static lane_owner_t* self()																			//	The owner of the calling thread, created on first use
+	{
+		struct holder_t
+		{
+			lane_owner_t*	owner = new lane_owner_t;
+			~holder_t() { this->owner->alive.store( false, std::memory_order_release ); this->owner->release(); }	//	Thread exit!
+		};
+		static thread_local holder_t holder;
+		return holder.owner;
+	}
+};
+
+
+//
+//		BasicStagingBuffers																			//	Every producer thread gets its own private double buffer (a `lane`), the consumer thread drains them all round-robin! Producers never fight each other for `primary`, they only meet the consumer thread on their own lane!
+//
+template< typename TMemory = HeapMemory >
+class BasicStagingBuffers																			//	NOTE: Commands from the SAME thread are still executed in order, but there is no ordering between DIFFERENT producer threads, but join() and tickets still cover every lane, the command thread drains them all in one pass!
+{
+public:
+	typedef typename BasicDoubleBuffer< TMemory >::queue_buffer_t queue_buffer_t;
+
+	struct lane_t
+	{
+		BasicDoubleBuffer< TMemory > buffers;
+		queue_buffer_t*		held;																		//	The buffer acquired by the owner thread, between acquire() and release()
+		lane_owner_t*		owner;																		//	Holds a reference ... when the owner thread has exited and the lane is drained, the next new thread takes the lane over
+		uint32_t			index;																		//	0 for the first lane, in the top bits of every ticket of this lane
+		lane_t*				next;
+	};
+	typedef lane_t* handle_t;
+	typedef TMemory memory_t;
+
+	static const uint32_t maxCommand = BasicDoubleBuffer< TMemory >::maxCommand;
+
+protected:
+	static const uint32_t LANE_SHIFT = 48;															//	Every lane has its own issued/completed pair (the SharedTickets of its double buffer), written only by the owner thread and by the command thread ... a ticket is { lane index, lane ticket }
+	static const uint64_t LANE_MASK = ( 1ull << LANE_SHIFT ) - 1;
+	static const uint32_t MAX_LANES = 1u << ( 64 - LANE_SHIFT );										//	Producer threads ALIVE at the same time, the lanes of exited threads are re-used
+
+	std::atomic< lane_t* >	lanes { nullptr };															//	Lanes are only ever pushed to the front of the list, and only deleted by the destructor, so the consumer can walk the list without a lock! There are never more lanes than producer threads that were alive at the same time
+	std::mutex				mtxLanes;
+	uint32_t				size = 0;
+	const uint64_t			id = nextId();																//	Unique for every object, so a cached lane can never be confused with a lane of an old, deleted queue at the same address!
+
+	static uint64_t nextId()
+	{
+		static std::atomic< uint64_t > counter { 0 };
+		return ++counter;
+	}
+
+	//
+	//		lane()																						//	Find (or create) the lane of the calling thread
+	//
+	lane_t* lane( const bool create = true )
+	{
+		struct lane_cache_t
+		{
+			uint64_t		id;
+			lane_t*			lane;
+		};
+		static const uint32_t CACHED = 8;
+		static thread_local lane_cache_t cache[ CACHED ];												//	The last 8 queues this thread used, keyed by queue id ... a thread feeding several queues in turn doesn't take mtxLanes on every command!
+		static thread_local uint32_t victim = 0;
+
+		for ( uint32_t i = 0; i < CACHED; i++ )
+			if ( cache[ i ].id == this->id )
+				return cache[ i ].lane;
+
+		lane_owner_t* self = lane_owner_t::self();
+		std::lock_guard< std::mutex > lock( this->mtxLanes );
+
+		lane_t* result = this->lanes.load( std::memory_order_acquire );
+		while ( result && result->owner != self )
+			result = result->next;
+
+		if ( result == nullptr && !create )
+			return nullptr;
+		if ( result == nullptr )																		//	First command from this thread, take over the lane of a thread that has exited ... its tickets just keep counting, so every old ticket stays valid!
+		{
+			result = this->lanes.load( std::memory_order_relaxed );
+			while ( result && ( result->owner->alive.load( std::memory_order_acquire ) || result->buffers.pending() ) )	//	Drained first, the command thread might still be executing its last commands
+				result = result->next;
+			if ( result )
+			{
+				result->owner->release();
+				result->owner = self;
+				self->retain();
+			}
+		}
+		if ( result == nullptr )																		//	... or create a new lane for it
+		{
+			result = new ( TMemory::allocateNode( sizeof( lane_t ) ) ) lane_t;
+			result->buffers.init( this->size );
+			result->held = nullptr;
+			result->owner = self;
+			self->retain();
+			result->next = this->lanes.load( std::memory_order_relaxed );
+			result->index = result->next ? result->next->index + 1 : 0;
+			assert( result->index < MAX_LANES );														//	65536 producer threads alive at the same time, the index would spill into the lane ticket!
+			this->lanes.store( result, std::memory_order_release );
+		}
+
+		cache[ victim ].id = this->id;																	//	Oldest entry out
+		cache[ victim ].lane = result;
+		victim = ( victim + 1 ) % CACHED;
+		return result;
+	}
+
+public:
+	~BasicStagingBuffers()
+	{
+		lane_t* lane = this->lanes.load();
+		while ( lane )
+		{
+			lane_t* next = lane->next;
+			lane->owner->release();
+			lane->~lane_t();
+			TMemory::deallocateNode( lane, sizeof( lane_t ) );
+			lane = next;
+		}
+	}
+
+	void init( const uint32_t size )
+	{
+		this->size = size;
+	}
+	void prefault() {}																					//	The lanes are created (and touched) by the producer threads, we can't place them from here
+
+	lane_t* acquire()
+	{
+		lane_t* lane = this->lane();
+		lane->held = lane->buffers.acquire();															//	Only the consumer thread can compete with us for this buffer!
+		return lane;
+	}
+	void release( lane_t* lane )
+	{
+		lane->buffers.release( lane->held );
+	}
+
+	static char* reserve( lane_t* lane, uint32_t& reserved, const Reserve mode = Reserve::Policy )
+	{
+		return BasicDoubleBuffer< TMemory >::reserve( lane->held, reserved, mode );
+	}
+
+	bool drain( uint64_t& finished )
+	{
+		bool executed = false;
+		for ( lane_t* lane = this->lanes.load( std::memory_order_acquire ); lane; lane = lane->next )
+			executed |= lane->buffers.drain( finished );
+		return executed;
+	}
+
+
+	//
+	//		tickets																						//	Per lane! The producers never touch a shared counter, and pending() / join() add up the lanes ... there is no order between the lanes anyway, see above
+	//
+	static uint64_t publish( lane_t* lane, const uint32_t commands )
+	{
+		return ( ( uint64_t ) lane->index << LANE_SHIFT ) | lane->buffers.publishOwn( commands );
+	}
+	uint64_t ticket()																					//	The ticket of everything the CALLING thread published so far ... join() waits for the other lanes too
+	{
+		lane_t* lane = this->lane( false );
+		return lane ? ( ( uint64_t ) lane->index << LANE_SHIFT ) | lane->buffers.ticket() : 0;
+	}
+	bool executed( const uint64_t ticket )
+	{
+		const uint32_t index = ( uint32_t ) ( ticket >> LANE_SHIFT );
+		for ( lane_t* lane = this->lanes.load( std::memory_order_acquire ); lane; lane = lane->next )	//	Newest lane first, there is one per producer thread, so the list is short
+			if ( lane->index == index )
+				return lane->buffers.executed( ticket & LANE_MASK );
+		return true;																					//	ticket 0, nothing was published
+	}
+	template< typename F >
+	bool tickets( F&& wait )
+	{
+		for ( lane_t* lane = this->lanes.load( std::memory_order_acquire ); lane; lane = lane->next )
+			if ( !wait( ( ( uint64_t ) lane->index << LANE_SHIFT ) | lane->buffers.ticket() ) )
+				return false;
+		return true;
+	}
+	uint64_t pending()
+	{
+		uint64_t result = 0;
+		for ( lane_t* lane = this->lanes.load( std::memory_order_acquire ); lane; lane = lane->next )
+			result += lane->buffers.pending();
+		return result;
+	}
+	void progress( CommandQueueStats& result )
+	{
+		for ( lane_t* lane = this->lanes.load( std::memory_order_acquire ); lane; lane = lane->next )
+			lane->buffers.progress( result );
+	}
+	#if defined(COMMANDQUEUE_ENABLE_STATS)
+	static void countBytes( lane_t* lane, const uint32_t reserved )
+	{
+		lane->buffers.countOwn( reserved );
+	}
+	#endif
+
+	void printBufferSizes()
+	{
+		for ( lane_t* lane = this->lanes.load( std::memory_order_acquire ); lane; lane = lane->next )
+			lane->buffers.printBufferSizes();
+	}
+	#if defined(COMMANDQUEUE_ENABLE_STATS)
+	void stats( CommandQueueStats& result )
+	{
+		for ( lane_t* lane = this->lanes.load( std::memory_order_acquire ); lane; lane = lane->next )
+			lane->buffers.stats( result );
+	}
+	#endif
+};
+typedef BasicStagingBuffers<> StagingBuffers;
+
+//
+//		RingBackend																					//	A fixed size ring buffer of `N` bytes (power-of-two)! The buffer NEVER grows, so there is no realloc() on the producer side and a hard ceiling on the memory used by the queue!
+//
+template< uint32_t N, OverflowPolicy Overflow = OverflowPolicy::Block, typename TMemory = HeapMemory >
+class RingBackend : public SharedTickets																//	Commands are still packed back-to-back, but a command can never wrap around the end of the ring, so when it doesn't fit we fill the end of the ring with a `padding` command and start again at the beginning!
+{
+	static_assert( N >= 64 && ( N & ( N - 1 ) ) == 0, "RingBackend size must be a power-of-two" );
+
+public:
+	typedef RingBackend* handle_t;
+	typedef TMemory memory_t;
+
+	static const uint32_t granularity = COMMAND_ALIGNMENT;											//	Every command is rounded up to 16 (or 64) bytes, so the gap at the end of the ring is always big enough for a padding command header!
+	static const uint32_t maxCommand = N / 2;														//	A single command can never be bigger than half the ring, otherwise the padding + command might never fit!
+
+protected:
+	char*					ring = nullptr;
+
+	std::atomic< uint32_t >	head { 0 };																	//	Published by the producers, everything before `head` is ready for the consumer thread
+	uint32_t				reserved_head = 0;															//	Only touched by the producer holding `lock`
+	std::atomic< bool >		lock { false };																//	Producers take turns writing to the ring, just like they take turns holding the `primary` buffer of the DoubleBuffer!
+	std::atomic< uint32_t >	lockWaiters { 0 };															//	Producers sleeping on cvLock, so release() only takes the mutex when somebody is actually waiting!
+	std::atomic< uint64_t >	drops { 0 };																//	OverflowPolicy::Drop only
+	#if defined(COMMANDQUEUE_ENABLE_STATS)
+	stat_t					acquireSpins{ 0 };
+	#endif
+	char					padProducer[ CACHE_LINE ];
+
+	std::atomic< uint32_t >	tail { 0 };																	//	Published by the consumer, everything before `tail` has been executed and can be overwritten
+	std::atomic< uint32_t >	waiting { 0 };																//	Number of producers waiting for space (sleeping on cvSpace, unless OverflowPolicy::Spin), so the consumer only takes the mutex when somebody is actually waiting!
+	char					padConsumer[ CACHE_LINE ];
+
+	std::mutex				mtxSpace;																	//	Not with OverflowPolicy::Spin
+	std::condition_variable	cvSpace;
+	std::mutex				mtxLock;
+	std::condition_variable	cvLock;
+	std::thread::id			consumer;																	//	The command thread, set by init() ... it must never wait for space (or for a producer that is waiting for space), nobody else can make it!
+
+	static void padding( void* ) {}																		//	Does nothing! Just skips to the beginning of the ring
+
+	uint32_t space()
+	{
+		return N - ( this->reserved_head - this->tail.load() );
+	}
+
+
+	//
+	//		waitForLock()																				//	Sleeps until the ring lock is released, then acquire() fights for it again
+	//
+	void waitForLock()
+	{
+		std::unique_lock<std::mutex> guard( this->mtxLock );
+		this->lockWaiters++;
+		this->cvLock.wait( guard, [this] { return !this->lock.load(); } );
+		this->lockWaiters--;
+	}
+
+
+	//
+	//		waitForSpace()
+	//
+	void waitForSpace( const uint32_t needed )
+	{
+		if ( Overflow == OverflowPolicy::Spin )
+		{
+			this->waiting++;																			//	Nobody sleeps, but a command thread trying to get the lock has to know we are stuck, see acquire()
+			uint32_t backoff = 1;
+			while ( this->space() < needed )
+			{
+				if ( backoff < 1024 )																	//	Keep checking, with exponentially longer gaps ... the consumer is probably just about to free up some space!
+				{
+					for ( uint32_t i = 0; i < backoff && this->space() < needed; i++ )
+						;
+					backoff *= 2;
+				}
+				else
+					std::this_thread::yield();															//	The consumer is stalled, give up our time slice
+			}
+			this->waiting--;
+		}
+		else
+		{
+			std::unique_lock<std::mutex> lock( this->mtxSpace );
+			this->waiting++;
+			this->cvSpace.wait( lock, [&] { return this->space() >= needed; } );
+			this->waiting--;
+		}
+	}
+
+public:
+	~RingBackend()
+	{
+		TMemory::deallocate( this->ring, N );
+	}
+
+	void init( const uint32_t /* size */ )																//	The size is fixed at compile time! Called on the command thread
+	{
+		this->ring = ( char* ) TMemory::allocate( N );
+		this->consumer = std::this_thread::get_id();
+	}
+	void prefault()
+	{
+		prefaultMemory( this->ring, N );
+	}
+
+	RingBackend* acquire()																				//	Returns nullptr on the command thread when the lock is held by a producer waiting for space, that producer waits for US ... reserve() then fails, the command is dropped
+	{
+		uint32_t spins = 0;
+		for ( ; this->lock.exchange( true, std::memory_order_acquire ); spins++ )
+		{
+			if ( spins < 64 )
+				cpuRelax();
+			else if ( std::this_thread::get_id() == this->consumer )								//	The command thread can't sleep, it might be the one everybody is waiting for!
+			{
+				if ( this->waiting.load() )
+					return nullptr;
+				std::this_thread::yield();
+			}
+			else if ( Overflow == OverflowPolicy::Spin )
+				std::this_thread::yield();
+			else
+				this->waitForLock();																	//	The producer holding the lock might be waiting for space in a full ring, don't burn the CPU the consumer needs to make that space!
+		}
+		COMMANDQUEUE_STAT( if ( spins ) statOwn( this->acquireSpins, spins ) );						//	We hold the lock now, so we are the only writer
+		return this;
+	}
+	void release( RingBackend* ring )
+	{
+		if ( ring == nullptr )																			//	acquire() gave up, see above
+			return;
+		this->head.store( this->reserved_head, std::memory_order_release );
+		this->lock.store( false );																		//	seq_cst! Either we see `lockWaiters`, or waitForLock() sees the lock is free ... never neither!
+		if ( Overflow != OverflowPolicy::Spin && this->lockWaiters.load() )
+		{
+			std::lock_guard<std::mutex> guard( this->mtxLock );
+			this->cvLock.notify_one();
+		}
+	}
+
+
+	//
+	//		reserve()																					//	Returns nullptr when the ring is full and we are not allowed to wait (try_execute), or the policy is to drop the command!
+	//
+	char* reserve( RingBackend* ring, uint32_t& reserved, const Reserve mode = Reserve::Policy )
+	{
+		if ( ring == nullptr )																			//	The command thread couldn't get the lock, see acquire()
+		{
+			if ( mode != Reserve::Fail )
+				this->drops.fetch_add( 1, std::memory_order_relaxed );
+			return nullptr;
+		}
+		reserved = ( reserved + granularity - 1 ) & ~( granularity - 1 );
+		if ( reserved > maxCommand )																	//	It would NEVER fit, no matter how long we wait ... fail, whatever the mode! The sizes known at compile time are already checked with a static_assert in BasicCommandQueue
+			return nullptr;
+
+		const uint32_t offset = this->reserved_head & ( N - 1 );
+		const uint32_t gap = ( offset + reserved > N ) ? N - offset : 0;							//	The command doesn't fit at the end of the ring, skip the rest of the ring with a padding command!
+
+		if ( this->space() < gap + reserved )
+		{
+			this->head.store( this->reserved_head, std::memory_order_release );							//	Ring is full! Make sure the consumer can see everything we have written so far!
+
+			if ( mode == Reserve::Fail )
+				return nullptr;
+			if ( ( mode == Reserve::Policy && Overflow == OverflowPolicy::Drop ) || std::this_thread::get_id() == this->consumer )	//	A command adding to its own full ring would wait for itself forever, drop it!
+			{
+				this->drops.fetch_add( 1, std::memory_order_relaxed );
+				return nullptr;
+			}
+			this->waitForSpace( gap + reserved );
+		}
+
+		if ( gap )
+		{
+			char* command = this->ring + offset;
+			*( ( PFNCommandHandler* ) command ) = padding;
+			#if defined(COMMANDQUEUE_TIMED_COMMANDS)
+			*( ( uint32_t* ) ( command + sizeof( PFNCommandHandler* ) ) ) = gap | COMMAND_UNTIMED;		//	Not a real command, don't time it!
+			#else
+			*( ( uint32_t* ) ( command + sizeof( PFNCommandHandler* ) ) ) = gap;
+			#endif
+			this->reserved_head += gap;
+		}
+
+		char* command = this->ring + ( this->reserved_head & ( N - 1 ) );
+		this->reserved_head += reserved;
+		return command;
+	}
+
+
+	//
+	//		drain()
+	//
+	bool drain( uint64_t& finished )
+	{
+		const uint64_t ticket = this->issued.load( std::memory_order_acquire );						//	BEFORE `head`! Every ticket up to here was released, so its commands are before `head`
+		const uint32_t end = this->head.load( std::memory_order_acquire );
+		uint32_t position = this->tail.load( std::memory_order_relaxed );
+
+		if ( position == end )
+		{
+			finished += this->complete( ticket );
+			return false;
+		}
+
+		while ( position != end )																		//	Two passes at most, when the commands wrap around the end of the ring!
+		{
+			const uint32_t offset = position & ( N - 1 );
+			const uint32_t length = ( end - position < N - offset ) ? end - position : N - offset;
+			executeCommands( this->ring + offset, this->ring + offset + length );
+			position += length;
+			this->tail.store( position );																//	seq_cst! Pairs with `waiting` ... either the producer sees the new tail, or we see that it's waiting!
+
+			if ( Overflow != OverflowPolicy::Spin && this->waiting.load() )								//	NOTE: With OverflowPolicy::Drop, async() can still be waiting for space!
+			{
+				std::lock_guard<std::mutex> lock( this->mtxSpace );
+				this->cvSpace.notify_all();
+			}
+		}
+		finished += this->complete( ticket );
+		return true;
+	}
+
+
+	uint64_t dropped()
+	{
+		return this->drops.load( std::memory_order_relaxed );
+	}
+
+
+	void printBufferSizes()
+	{
+		printf( "Ring Buffer size: %d KB\n", N / 1024 );
+	}
+	#if defined(COMMANDQUEUE_ENABLE_STATS)
+	void stats( CommandQueueStats& result )
+	{
+		result.acquireSpins += this->acquireSpins.load( std::memory_order_relaxed );
+	}
+	#endif
+};
+
+//
+//		Command stubs																				//	These functions essentially `extract` the function call parameters (data) from the Command Queue buffer and call your function with them! They are the functions that are actually called by the thread inner-loop!
+//
+template< size_t... I > struct index_sequence_t {};													//	C++11 doesn't have std::index_sequence, so we roll our own!
+template< size_t N, size_t... I > struct make_index_sequence_t : make_index_sequence_t< N - 1, N - 1, I... > {};
+template< size_t... I > struct make_index_sequence_t< 0, I... > { typedef index_sequence_t< I... > type; };
+
+template< typename... T > struct packed_args_t														//	rawExecute() only! The parameters are packed back-to-back in the data section (no padding), `size` and `offset< I >` are calculated at compile time!
+{
+	static const uint32_t size = 0;
+
+	static void destroy( char* /* data */ ) {}
+};
+template< typename T1, typename... T > struct packed_args_t< T1, T... >
+{
+	static const uint32_t size = sizeof( T1 ) + packed_args_t< T... >::size;
+
+	static void destroy( char* data )																	//	Called by the stubs after your function returns! Does nothing for simple types like int, char* etc.
+	{
+		( ( T1* ) data )->~T1();
+		packed_args_t< T... >::destroy( data + sizeof( T1 ) );
+	}
+
+	template< size_t I, typename = void > struct offset												//	offset of parameter I, relative to the first parameter
+	{
+		static const uint32_t value = sizeof( T1 ) + packed_args_t< T... >::template offset< I - 1 >::value;
+	};
+	template< typename V > struct offset< 0, V >
+	{
+		static const uint32_t value = 0;
+	};
+};
+
+
+//
+//		packArgs()																					//	rawExecute() only! Constructs the parameters back-to-back in the data section. Objects are MOVED into the buffer when you pass them with std::move(), no extra allocation or copy!
+//
+inline void packArgs( char* /* data */ ) {}
+template< typename T1, typename... T >
+inline void packArgs( char* data, T1&& v1, T&&... v )
+{
+	typedef typename std::decay< T1 >::type arg_t;													//	The type we store, "Hello" is stored as a `const char*`, not a char array!
+	new ( data ) arg_t( std::forward< T1 >( v1 ) );													//	placement new! The buffer is uninitialised memory, so we can't just assign to it!
+	packArgs( data + sizeof( arg_t ), std::forward< T >( v )... );
+}
+
+
+//
+//		args_layout_t																				//	The layout of the data section: your function (or lambda) and the parameters, in order, each one padded to its own alignof()! Everything is calculated at compile time, `Offset` is where the next value may start
+//
+template< uint32_t Offset, typename... T > struct args_layout_t
+{
+	static const uint32_t size = Offset;
+
+	static void construct( char* /* data */ ) {}
+	static void destroy( char* /* data */ ) {}
+};
+template< uint32_t Offset, typename T1, typename... T > struct args_layout_t< Offset, T1, T... >
+{
+	static_assert( alignof( T1 ) <= COMMAND_ALIGNMENT, "This parameter needs more alignment than the command records have, #define COMMANDQUEUE_RECORD_ALIGNMENT 64 before you include CommandQueue.hpp" );
+
+	static const uint32_t offset = ( ( COMMAND_HEADER + Offset + alignof( T1 ) - 1 ) & ~uint32_t( alignof( T1 ) - 1 ) ) - COMMAND_HEADER;	//	Aligned relative to the start of the RECORD, that's the address with COMMAND_ALIGNMENT, the data section is only 16 byte aligned!
+	typedef args_layout_t< offset + sizeof( T1 ), T... > next_t;
+	static const uint32_t size = next_t::size;
+
+	template< size_t I, typename = void > struct at													//	offset of value I, relative to the data section
+	{
+		static const uint32_t value = next_t::template at< I - 1 >::value;
+	};
+	template< typename V > struct at< 0, V >
+	{
+		static const uint32_t value = offset;
+	};
+
+	template< typename U1, typename... U >
+	static void construct( char* data, U1&& v1, U&&... v )											//	placement new! The buffer is uninitialised memory, so we can't just assign to it! Objects are MOVED into the buffer when you pass them with std::move(), no extra allocation or copy!
+	{
+		new ( data + offset ) T1( std::forward< U1 >( v1 ) );
+		next_t::construct( data, std::forward< U >( v )... );
+	}
+	static void destroy( char* data )																	//	Called by the stubs after your function returns! Does nothing for simple types like int, char* etc.
+	{
+		( ( T1* ) ( data + offset ) )->~T1();
+		next_t::destroy( data );
+	}
+};
+
+
+template< typename TCB, typename... T >
+struct command_stub_t																				//	TCB is a function pointer, or ANY callable object (capturing lambdas etc.), it's stored inline in the data section right in front of the parameters!
+{
+	template< typename TLayout, size_t First, size_t I >
+	static typename std::tuple_element< I, std::tuple< T... > >::type&& arg( char* data )			//	Parameter I (value First + I in the layout), as an rvalue ... every command is only called once, so your function can take the parameters by value, const& or && and move-only types like std::unique_ptr work!
+	{
+		return std::move( *( ( typename std::tuple_element< I, std::tuple< T... > >::type* ) ( data + TLayout::template at< First + I >::value ) ) );
+	}
+
+	template< size_t... I >
+	static void execute( char* data, index_sequence_t< I... > )
+	{
+		typedef args_layout_t< 0, TCB, T... > layout_t;											//	[ function ][ parameters ... ]
+		TCB& function = *( ( TCB* ) ( data + layout_t::template at< 0 >::value ) );
+		function( arg< layout_t, 1, I >( data )... );
+		layout_t::destroy( data );
+	}
+	template< typename R, size_t... I >
+	static void returns( char* data, index_sequence_t< I... > )										//	We store the return address directly after the function pointer address, the parameters come after that!
+	{
+		typedef args_layout_t< 0, TCB, R, T... > layout_t;										//	[ function ][ return address ][ parameters ... ]
+		TCB& function = *( ( TCB* ) ( data + layout_t::template at< 0 >::value ) );
+		**( ( R* ) ( data + layout_t::template at< 1 >::value ) ) = function( arg< layout_t, 2, I >( data )... );
+		layout_t::destroy( data );
+	}
+};
+
+template< typename TCB, typename... T >
+void executeStub( char* data )
+{
+	command_stub_t< TCB, T... >::execute( data, typename make_index_sequence_t< sizeof...( T ) >::type() );
+}
+template< typename TCB, typename R, typename... T >
+void returnStub( char* data )
+{
+	command_stub_t< TCB, T... >::template returns< R >( data, typename make_index_sequence_t< sizeof...( T ) >::type() );
+}
+
+
+//
+//		Futures																						//	async() returns a `future`, the result is written into a small pooled slot, so you only wait for YOUR command, not the whole queue like join()!
+//
+template< typename R > struct future_value_t														//	Raw storage for the result, it's only constructed once the command has executed!
+{
+	alignas( R ) char storage[ sizeof( R ) ];
+
+	template< typename F, typename... A >
+	void set( F& function, A&&... a )	{ new ( storage ) R( function( std::forward< A >( a )... ) ); }
+	R& get()							{ return *( ( R* ) storage ); }
+	R take()							{ return std::move( this->get() ); }
+	void destroy()						{ this->get().~R(); }
+	template< typename G >
+	auto apply( G& function ) -> decltype( function( std::declval< R >() ) ) { return function( this->take() ); }	//	then() ... your continuation receives the result by value/rvalue
+};
+template<> struct future_value_t< void >															//	async() on a function that returns nothing, the future just tells you when it's done!
+{
+	template< typename F, typename... A >
+	void set( F& function, A&&... a )	{ function( std::forward< A >( a )... ); }
+	void get()							{}
+	void take()							{}
+	void destroy()						{}
+	template< typename G >
+	auto apply( G& function ) -> decltype( function() ) { return function(); }
+};
+
+struct continuation_t																				//	then() ... a continuation waiting for a result, the command thread runs it directly after the command that produces it
+{
+	void					( *run )( continuation_t* self );										//	Runs the continuation, and frees it
+};
+
+struct future_base_t
+{
+	std::atomic< bool >		done;																	//	Set by the command thread AFTER the result was written
+	std::atomic< bool >		waiting;																//	Set by wait() before it goes to sleep, the command thread only locks + notifies when somebody is actually sleeping!
+	std::atomic< uint32_t >	refs;																	//	The future AND the command both hold a reference, whoever is last returns the slot to the pool
+	std::atomic< continuation_t* > continuation;													//	nullptr, then() attaches one, or finished() once the command completed ... too late to attach, then() queues the continuation itself
+
+	static continuation_t* finished()
+	{
+		static continuation_t sentinel = { nullptr };
+		return &sentinel;
+	}
+};
+
+template< typename T, typename TMemory >															//	Future states and then() continuations ... allocated on YOUR thread, but mostly freed on the command thread, so a thread_local free list would never refill!
+struct node_pool_t
+{
+	struct node_t { node_t* next; };
+
+	static std::atomic< node_t* >& returned()														//	Freed nodes, pushed by whoever frees them ... an empty pool takes the whole list at once, so there's no ABA and no lock!
+	{
+		static std::atomic< node_t* > returned { nullptr };
+		return returned;
+	}
+	static std::atomic< uint32_t >& count()															//	Nodes in all the lists, don't hoard more than 64 per type
+	{
+		static std::atomic< uint32_t > count { 0 };
+		return count;
+	}
+	struct local_t
+	{
+		node_t*	free = nullptr;
+
+		~local_t()
+		{
+			while ( free )
+			{
+				node_t* next = free->next;
+				TMemory::deallocateNode( free, sizeof( T ) );
+				count().fetch_sub( 1, std::memory_order_relaxed );
+				free = next;
+			}
+		}
+	};
+	static local_t& local()
+	{
+		static thread_local local_t local;
+		return local;
+	}
+
+	static void* allocate()
+	{
+		local_t& pool = local();
+		if ( pool.free == nullptr && returned().load( std::memory_order_relaxed ) )
+			pool.free = returned().exchange( nullptr, std::memory_order_acquire );
+		node_t* node = pool.free;
+		if ( node == nullptr )
+			return TMemory::allocateNode( sizeof( T ) );													//	Only until the pool is warmed up!
+		pool.free = node->next;
+		count().fetch_sub( 1, std::memory_order_relaxed );
+		return node;
+	}
+	static void free( void* memory )
+	{
+		if ( count().load( std::memory_order_relaxed ) >= 64 )
+		{
+			TMemory::deallocateNode( memory, sizeof( T ) );
+			return;
+		}
+		count().fetch_add( 1, std::memory_order_relaxed );
+		node_t* node = static_cast< node_t* >( memory );
+		node->next = returned().load( std::memory_order_relaxed );
+		while ( !returned().compare_exchange_weak( node->next, node, std::memory_order_release, std::memory_order_relaxed ) )
+			;
+	}
+};
+
+template< typename R, typename TMemory = HeapMemory >												//	TMemory ... the memory policy of the queue's backend, so the free lists are per policy too!
+struct future_state_t : future_base_t
+{
+	typedef node_pool_t< future_state_t, TMemory > pool_t;											//	Recycled slots, see node_pool_t ... then() releases the state of the previous command on the command thread, so a thread_local free list would never give it back to your thread!
+
+	future_value_t< R >		value;
+
+	static future_state_t* acquire()
+	{
+		future_state_t* state = new ( pool_t::allocate() ) future_state_t;
+		state->done.store( false, std::memory_order_relaxed );
+		state->waiting.store( false, std::memory_order_relaxed );
+		state->refs.store( 2, std::memory_order_relaxed );											//	1 for the future, 1 for the command
+		state->continuation.store( nullptr, std::memory_order_relaxed );
+		return state;
+	}
+	void release()
+	{
+		if ( this->refs.fetch_sub( 1, std::memory_order_acq_rel ) != 1 )
+			return;
+		if ( this->done.load( std::memory_order_relaxed ) )
+			this->value.destroy();
+		this->~future_state_t();
+		pool_t::free( this );
+	}
+};
+
+template< typename F, typename... T > struct async_result_t										//	What your function returns when we call it with the stored parameters
+{
+	typedef typename std::decay< decltype( std::declval< F& >()( std::declval< typename std::decay< T >::type >()... ) ) >::type type;
+};
+template< typename G, typename R > struct then_result_t : async_result_t< G, R > {};				//	What your then() continuation returns, it gets the result of the previous command ...
+template< typename G > struct then_result_t< G, void > : async_result_t< G > {};					//	... or nothing at all when that one returned void!
+
+
+//
+//		CommandQueueOptions																			//	Everything about the command thread and its buffers that you can decide at construction, BEFORE the thread starts executing commands!
+//
+struct CommandQueueOptions
+{
+	uint32_t				size = 256;																	//	Initial size of the buffers, see the constructors
+	int						node = -1;																	//	NUMA node: the command thread runs on the CPUs of this node, and its buffers are allocated (first touched) on it ... -1 = wherever the OS likes
+	std::vector< int >		cpus;																		//	Pin the command thread to these CPUs ... empty = all the CPUs of `node`, or not pinned at all
+	int						policy = -1;																//	SCHED_FIFO or SCHED_RR for a real-time command thread (needs CAP_SYS_NICE or an rtprio limit!), SCHED_OTHER etc. ... -1 = inherit it from the thread that creates the queue
+	int						priority = 0;																//	sched_priority for `policy`, 1..99 for SCHED_FIFO / SCHED_RR
+	std::string				name;																		//	Shows up in top -H, gdb, perf ... max 15 characters on Linux, longer names are cut
+};
+
+
+//
+//		configureThread()																			//	Called on the command thread itself, before the buffers are allocated and before the first command! Affinity, NUMA and the scheduler are Linux only, the name works on macOS too ... everywhere else asking for them makes configured() false
+//
+inline bool numaNodeCpus( const int node, std::vector< int >& cpus )								//	Reads /sys/devices/system/node/nodeN/cpulist, eg. "0-11,24-35"
+{
+	#if defined(__linux__)
+	char path[ 64 ];
+	snprintf( path, sizeof( path ), "/sys/devices/system/node/node%d/cpulist", node );
+	FILE* file = fopen( path, "r" );
+	if ( file == nullptr )
+		return false;
+	char list[ 4096 ];
+	const bool read = fgets( list, sizeof( list ), file ) != nullptr;
+	fclose( file );
+	if ( !read )
+		return false;
+
+	for ( char* p = list; *p >= '0' && *p <= '9'; )
+	{
+		const int first = ( int ) strtol( p, &p, 10 );
+		const int last = *p == '-' ? ( int ) strtol( p + 1, &p, 10 ) : first;
+		for ( int cpu = first; cpu <= last; cpu++ )
+			cpus.push_back( cpu );
+		if ( *p == ',' )
+			p++;
+	}
+	return !cpus.empty();
+	#else
+	( void ) node; ( void ) cpus;
+	return false;
+	#endif
+}
+
+inline bool configureThread( const CommandQueueOptions& options )									//	Returns false when something you asked for was refused, the command thread still runs ... see configured()
+{
+	bool result = true;
+	#if defined(__linux__)
+	std::vector< int > cpus = options.cpus;
+	if ( cpus.empty() && options.node >= 0 )
+		numaNodeCpus( options.node, cpus );
+	if ( !cpus.empty() )
+	{
+		cpu_set_t set;
+		CPU_ZERO( &set );
+		for ( size_t i = 0; i < cpus.size(); i++ )
+			if ( cpus[ i ] >= 0 && cpus[ i ] < CPU_SETSIZE )
+				CPU_SET( cpus[ i ], &set );
+		result &= ::sched_setaffinity( 0, sizeof( set ), &set ) == 0;
+	}
+	if ( options.node >= 0 )
+	{
+		unsigned long nodes[ 1024 / ( 8 * sizeof( unsigned long ) ) ] = {};
+		if ( ( size_t ) options.node < 8 * sizeof( nodes ) )
+		{
+			nodes[ options.node / ( 8 * sizeof( unsigned long ) ) ] |= 1UL << ( options.node % ( 8 * sizeof( unsigned long ) ) );
+			result &= ::syscall( SYS_set_mempolicy, 1 /* MPOL_PREFERRED */, nodes, 8 * sizeof( nodes ) + 1 ) == 0;	//	Every page THIS thread faults in comes from `node` (if it has any free), no libnuma needed! maxnode + 1, the kernel only reads maxnode - 1 bits
+		}
+		else
+			result = false;																			//	Doesn't fit the mask, and no machine has that many nodes anyway
+	}
+	if ( options.policy >= 0 )
+	{
+		sched_param param = {};
+		param.sched_priority = options.priority;
+		result &= ::pthread_setschedparam( ::pthread_self(), options.policy, &param ) == 0;
+	}
+	if ( !options.name.empty() )
+		result &= ::pthread_setname_np( ::pthread_self(), options.name.substr( 0, 15 ).c_str() ) == 0;
+	#else
+	result = options.cpus.empty() && options.node < 0 && options.policy < 0;						//	No affinity, NUMA or scheduler here ... you asked for it and didn't get it, so configured() must say so!
+	#if defined(__APPLE__)
+	if ( !options.name.empty() )
+		result &= ::pthread_setname_np( options.name.c_str() ) == 0;
+	#else
+	result &= options.name.empty();
+	#endif
+	#endif
+	return result;
+}
+
+
+template< typename TBackend = DoubleBuffer, typename TWait = SpinPark >								//	TBackend = DoubleBuffer (default), StagingBuffers or RingBackend< N > ... see the typedefs at the end of the file! TWait = SpinPark (default), SpinYield or BusySpin
+class BasicCommandQueue
 {
 protected:																								//	protected - incase you want to extend it, so your derived object can access any functions it needs! You are welcome to extend or modify it!
 
@@ -56,25 +1793,38 @@ protected:																								//	protected - incase you want to extend it, s
 	//	char*				data[ count ];																//	`optional` member of the structure! Not all commands/function calls require data!
 	};
 
-	struct queue_buffer_t
-	{
-		char*				commands;
-		uint32_t			size;
-		uint32_t			used;
-	};
-	queue_buffer_t			buffer[ 2 ];
+	typedef typename TBackend::handle_t handle_t;
+	typedef typename TBackend::memory_t memory_t;
 
-	std::atomic< queue_buffer_t* > primary	 = &buffer[ 0 ];
-	std::atomic< queue_buffer_t* > secondary = &buffer[ 1 ];
+	TBackend				backend;
+	char					padBackend[ CACHE_LINE ];												//	Whatever the backend puts last, keep it away from the wake up state below ... the tickets live in the backend too, see SharedTickets
+
+	#if defined(COMMANDQUEUE_ENABLE_STATS)
+	stat_t					drains{ 0 };																//	Only written by the command thread, see CommandQueueStats
+	stat_t					maxBatch{ 0 };
+	stat_t					parks{ 0 };
+	#endif
+	#if defined(COMMANDQUEUE_TIMED_COMMANDS)
+	command_recorder_t		recorder;																	//	Written by the command thread, see latency() and profile()
+	#endif
+	std::atomic< uint32_t >	ticketWaiters{ 0 };															//	Number of threads sleeping in wait_until(), so the command thread only takes mtxTicket when somebody is actually waiting!
+	std::mutex				mtxTicket;
+	std::condition_variable	cvTicket;
 
 	std::mutex				mtxDequeue;
 	std::condition_variable cvDequeue;
+	std::atomic< ConsumerState > state{ ConsumerState::Draining };										//	Only written by the consumer thread on a transition (not per command!), and by the producer that wakes it up ... never Parked with BusySpin and SpinYield
 
 	std::mutex				mtxJoin;
 	std::condition_variable cvJoin;
 
+	std::mutex				mtxFuture;																	//	Shared by all the futures of this queue, but only used when somebody is actually sleeping in future::wait()
+	std::condition_variable cvFuture;
+
 	std::thread*			hThread;
-	bool		volatile	shutdown = false;
+	bool					started = false;															//	Under mtxJoin, the constructor waits for the command thread to set up its buffers
+	bool					configuredOk = true;														//	Written before `started`, see configured()
+	std::atomic< bool >		shutdown{ false };
 
 
 	//
@@ -82,82 +1832,155 @@ protected:																								//	protected - incase you want to extend it, s
 	//
 	void thread()
 	{
-		queue_buffer_t* buffer = secondary.exchange( nullptr );
-
+		uint32_t idle = 0;																				//	Number of times in a row we found nothing to do
 		while ( true )
 		{
-			buffer = primary.exchange( buffer );
-
-			while ( buffer == nullptr )
-				buffer = secondary.exchange( nullptr );
-
-			if ( buffer->used )
+			if ( this->drain() )
 			{
-				char* base_addr = buffer->commands;
-				const char* end = buffer->commands + buffer->used;
-				do																												//	The inner loop - 6 CPU instructions (VS2015 Release build) for the do..while()! This is the loop that actually makes the function calls! Each `command` (function pointer + data) is VARIABLE in length, depending on the number of parameters! So I don't used a fixed structure or std::queue, I do everything the old-school way, with direct pointers!
+				if ( idle )
 				{
-					( *( PFNCommandHandler* ) base_addr )( base_addr + sizeof( PFNCommandHandler* ) + sizeof( uint32_t ) );		//	I know this might look like a train-wreck, but it's actually the heart and soul of this class! The inner loop! You know we always say, you should just optimize the inner-loops! The code that requires the maximum speed! Well, this is it! 6 CPU instructions in total to execute an entire queue of function calls! You don't get much faster than that! You cannot do this faster with ANY STL container! This is what low level C/C++ and Assembler knowledge gets you! Incredible speed!
-					base_addr += ( *( uint32_t* ) ( base_addr + sizeof( PFNCommandHandler* ) ) );								//	Calculate address of next function ... I guess this would be the equivalent of a queue `pop`. What we are doing is accessing the `size` value directly with a pointer. After the initial function pointer address (stored at the beginning of the `base_address`), there is a 32-bit offset number to the next function call. We just add this number to base_address to jump ahead to the next function call! There is no real `popping` of the data, that would be too slow and completely unecessary! We just make the function calls and recycle the buffer!
+					this->state.store( ConsumerState::Draining, std::memory_order_relaxed );
+					idle = 0;
 				}
-				while ( base_addr < end );																						//	do while we haven't reached the end!
-				buffer->used = 0;																								//	This essentially allows the buffer to be recycled! After this, this current buffer is exchanged with the `front-facing` / active buffer. So the `front-facing` / active is essentially a reset buffer with this. `used` is just an offset, and we just basically reset it to the beginning!
 			}
 			else if ( this->shutdown )
 				break;
+			else if ( idle < TWait::spins || !TWait::park || idle - TWait::spins < TWait::yields )
+			{
+				if ( idle == 0 )
+					this->state.store( ConsumerState::Spinning, std::memory_order_relaxed );
+				if ( idle < TWait::spins )
+					cpuRelax();
+				else
+					std::this_thread::yield();
+				idle++;
+			}
 			else
 			{
-				std::unique_lock<std::mutex> lock( mtxDequeue );
-				cvDequeue.wait( lock );
-				lock.unlock();
+				this->park();
+				idle = 0;
+			}
+		}
+	}
+
+
+	//
+	//		drain()																						//	backend.drain() executes the commands AND publishes their tickets, we only wake up the threads waiting for them
+	//
+	bool drain()
+	{
+		uint64_t finished = 0;
+		const bool executed = this->backend.drain( finished );
+		if ( finished )
+		{
+			#if defined(COMMANDQUEUE_ENABLE_STATS)
+			statOwn( this->drains, 1 );
+			if ( finished > this->maxBatch.load( std::memory_order_relaxed ) )
+				this->maxBatch.store( finished, std::memory_order_relaxed );
+			#endif
+			if ( this->ticketWaiters.load() )															//	seq_cst! The backend published the tickets with a seq_cst store, so either we see `ticketWaiters`, or wait_until() sees the new ticket ... never neither!
+			{
+				std::lock_guard<std::mutex> lock( this->mtxTicket );
+				this->cvTicket.notify_all();
 			}
 		}
+		return executed;
+	}
+
+
+	//
+	//		park()																						//	Puts the consumer thread to sleep until a producer wakes it up in wakeConsumer()
+	//
+	void park()
+	{
+		this->state.store( ConsumerState::Parked, std::memory_order_relaxed );
+		std::atomic_thread_fence( std::memory_order_seq_cst );										//	Pairs with the fence in wakeConsumer() ... either WE see the new command below, or the producer sees `Parked`, never neither!
+		if ( !this->drain() && !this->shutdown )
+		{
+			COMMANDQUEUE_STAT( statOwn( this->parks, 1 ) );
+			std::unique_lock<std::mutex> lock( this->mtxDequeue );
+			this->cvDequeue.wait( lock, [this] { return this->state.load( std::memory_order_relaxed ) != ConsumerState::Parked || this->shutdown; } );	//	The producer changes the state under the lock, so we can't miss it!
+		}
+		this->state.store( ConsumerState::Draining, std::memory_order_relaxed );
 	}
 
 
 	//
 	//		init()
 	//
-	void init( const uint32_t size )
+	void init( const CommandQueueOptions& options )
 	{
 		//
-		//		Initialize Double Buffers
+		//		Start thread
 		//
-		this->buffer[ 0 ].commands = ( char* ) ::malloc( size );
-		this->buffer[ 1 ].commands = ( char* ) ::malloc( size );
+		this->hThread = new std::thread( &BasicCommandQueue::start, this, options );
 
-		this->buffer[ 0 ].size = size;
-		this->buffer[ 1 ].size = size;
+		std::unique_lock< std::mutex > lock( this->mtxJoin );											//	Nobody can add a command before the buffers exist!
+		this->cvJoin.wait( lock, [this] { return this->started; } );
+	}
 
-		this->buffer[ 0 ].used = 0;
-		this->buffer[ 1 ].used = 0;
+
+	//
+	//		start()																						//	The first thing the command thread does: move to the right CPUs / node, set its priority and name, THEN allocate the buffers, so they are local to the thread that drains them!
+	//
+	void start( const CommandQueueOptions options )
+	{
+		this->configuredOk = configureThread( options );
+		#if defined(COMMANDQUEUE_TIMED_COMMANDS)
+		commandRecorder() = &this->recorder;
+		#endif
 
 		//
-		//		Start thread
+		//		Initialize Buffers
 		//
-		this->hThread = new std::thread( &CommandQueue::thread, this );
+		this->backend.init( options.size );
+		if ( options.node >= 0 || !options.cpus.empty() )												//	Pinned to a node OR to CPUs, either way the pages should come from the memory next to the CPUs the thread runs on, and only first touch puts them there!
+			this->backend.prefault();
+
+		{
+			std::lock_guard< std::mutex > lock( this->mtxJoin );
+			this->started = true;
+		}
+		this->cvJoin.notify_all();
+
+		this->thread();
 	}
 
 
 	//
 	//		acquireBuffer()
 	//
-	queue_buffer_t* acquireBuffer()
+	handle_t acquireBuffer()
 	{
-		queue_buffer_t* result;
-		while ( ( result = primary.exchange( nullptr ) ) == nullptr )
-			//	::Sleep( 0 );																			//	optional ... there are 2 producers fighting for the buffer, but they acquire and release very quickly, within a few clock cycles, it's less efficient to sleep!
-			;
-		return result;
+		return this->backend.acquire();
 	}
 	//
-	//		releaseBuffer()
+	//		releaseBuffer()																				//	Publishes the `commands` written to `buffer`, and returns the ticket of the last one ... see wait_until()
 	//
-	void releaseBuffer( queue_buffer_t* buffer )
+	uint64_t releaseBuffer( handle_t buffer, const uint32_t commands = 1 )
 	{
-		queue_buffer_t* exp = nullptr;
-		if ( !primary.compare_exchange_strong( exp, buffer ) )
-			secondary = buffer;																			//	Because we use Double Buffers, one is in primary, so put the other in secondary! Actually, there is a very important reason why we do this, if you are clever enough you will realise it! The thread is actually waiting for us to write this in a special while loop, look carefully! This is the second `edge` case of swopping the buffers! It's brilliant!
+		this->backend.release( buffer );
+		const uint64_t ticket = this->backend.publish( buffer, commands );								//	AFTER the release! So when the command thread sees this ticket, it also sees the commands
+		this->wakeConsumer();
+		return ticket;
+	}
+	//
+	//		wakeConsumer()
+	//
+	void wakeConsumer()
+	{
+		if ( !TWait::park )																				//	The consumer never sleeps, nothing to do!
+			return;
+		if ( !TWait::notifyAlways )
+		{
+			std::atomic_thread_fence( std::memory_order_seq_cst );									//	Our command is published (backend.release()) BEFORE we look at the state ... see park()
+			if ( this->state.load( std::memory_order_relaxed ) != ConsumerState::Parked )			//	The consumer is draining or spinning 99% of the time under load, then we skip the mutex AND the notify syscall!
+				return;
+		}
+		{
+			std::lock_guard<std::mutex> lock( this->mtxDequeue );
+			this->state.store( ConsumerState::Draining, std::memory_order_relaxed );				//	Only the parked -> awake transition pays for the wake up!
+		}
 		this->cvDequeue.notify_one();
 	}
 
@@ -166,544 +1989,648 @@ protected:																								//	protected - incase you want to extend it, s
 	//		allocCommand()
 	//
 	template< typename TCB >
-	char* allocCommand( queue_buffer_t* buffer, const TCB function, const uint32_t size )				//	appends a new command to the buffer, sets the function pointer and allocates space (malloc-style) for a data buffer, returns the address to the data buffer like malloc()!
+	char* allocCommand( handle_t buffer, const TCB function, const uint32_t size, const Reserve mode = Reserve::Policy )	//	appends a new command to the buffer, sets the function pointer and allocates space (malloc-style) for a data buffer, returns the address to the data buffer like malloc()! Returns nullptr when a bounded queue is full, see OverflowPolicy!
 	{
-		const uint32_t base = buffer->used;																//	store base address of this command, it's an array index into a char* buffer
-		const uint32_t reserved = sizeof( TCB* ) + sizeof( uint32_t ) + size;							//	calculate the total size of this command, including function pointer, + sizeof( UINT ) + data
-		buffer->used += reserved;
-		if ( buffer->used > buffer->size )																//	check if we need to resize the buffer
-		{
-			do buffer->size *= 2;																		//	multiply size by *= 2, keep checking to make sure we have enough space for everything!
-			while ( buffer->used > buffer->size );
-			buffer->commands = (char*) ::realloc( buffer->commands, buffer->size );						//	extend the buffer, we will re-use this buffer, I feel if you needed a buffer this big before, it's likely you'll need it again! So I NEVER reduce the size of the buffer! This is up to you!
-		}
+		uint32_t reserved = commandSize( size );														//	calculate the total size of this command, including function pointer, + sizeof( UINT ) + data ... padded, so the NEXT command is aligned too!
 
-		char* command = &buffer->commands[ base ];														//	Get the base address of the command
+		char* command = this->backend.reserve( buffer, reserved, mode );								//	Get the base address of the command, NOTE: the backend is allowed to round up `reserved`!
+		if ( command == nullptr )
+			return nullptr;
+		COMMANDQUEUE_STAT( this->backend.countBytes( buffer, reserved ) );
 		*( ( TCB* ) command ) = function;																//	Write the function pointer address
 		*( ( uint32_t* ) ( command + sizeof( TCB* ) ) ) = reserved;										//	Write the total size of the command
+		#if defined(COMMANDQUEUE_ENABLE_LATENCY)
+		*( ( uint64_t* ) ( command + COMMAND_STAMP ) ) = latencyStamp();
+		#endif
 
-		return command + sizeof( TCB* ) + sizeof( uint32_t );											//	return the address to the `data` section
+		return command + COMMAND_HEADER;																//	return the address to the `data` section
 	}
 
 
 	//
-	//		execute() Stub functions																	//	These function essentially `extract` the function call parameters (data) from the Command Queue buffer and call your function with them!
+	//		markHandler()																				//	COMMANDQUEUE_ENABLE_PROFILING only! A plain function pointer is the first thing in the data section, so profile it by THAT, not by the stub that every `void( int )` function shares ... async() and then() put it first too, see handler_key_t
 	//
-	template< typename TCB >
-	static void executeStubV0( char* data )
+	#if defined(COMMANDQUEUE_ENABLE_PROFILING)
+	template< typename F >
+	static void markHandler( char* data )
 	{
-		( *( ( TCB* ) data ) )();
-	}
-	template< typename TCB, typename T1 >
-	static void executeStubV1( char* data )
-	{
-		const TCB function = *( ( TCB* ) data );
-		const T1 v1 = *( ( T1* ) ( data + sizeof( TCB* ) ) );
-		function( v1 );
-	}
-	template< typename TCB, typename T1, typename T2 >
-	static void executeStubV2( char* data )
-	{
-		const TCB function = *( ( TCB* ) data );
-		const T1 v1 = *( ( T1* ) ( data + sizeof( TCB* ) ) );
-		const T2 v2 = *( ( T2* ) ( data + sizeof( TCB* ) + sizeof( T1 ) ) );
-		function( v1, v2 );
-	}
-	template< typename TCB, typename T1, typename T2, typename T3 >
-	static void executeStubV3( char* data )
-	{
-		const TCB function = *( ( TCB* ) data );
-		const T1 v1 = *( ( T1* ) ( data + sizeof( TCB* ) ) );
-		const T2 v2 = *( ( T2* ) ( data + sizeof( TCB* ) + sizeof( T1 ) ) );
-		const T3 v3 = *( ( T3* ) ( data + sizeof( TCB* ) + sizeof( T1 ) + sizeof( T2 ) ) );
-		function( v1, v2, v3 );
-	}
-	template< typename TCB, typename T1, typename T2, typename T3, typename T4 >
-	static void executeStubV4( char* data )
-	{
-		const TCB function = *( ( TCB* ) data );
-		const T1 v1 = *( ( T1* ) ( data + sizeof( TCB* ) ) );
-		const T2 v2 = *( ( T2* ) ( data + sizeof( TCB* ) + sizeof( T1 ) ) );
-		const T3 v3 = *( ( T3* ) ( data + sizeof( TCB* ) + sizeof( T1 ) + sizeof( T2 ) ) );
-		const T4 v4 = *( ( T4* ) ( data + sizeof( TCB* ) + sizeof( T1 ) + sizeof( T2 ) + sizeof( T3 ) ) );
-		function( v1, v2, v3, v4 );
-	}
-	template< typename TCB, typename T1, typename T2, typename T3, typename T4, typename T5 >
-	static void executeStubV5( char* data )
-	{
-		const TCB function = *( ( TCB* ) data );
-		const T1 v1 = *( ( T1* ) ( data + sizeof( TCB* ) ) );
-		const T2 v2 = *( ( T2* ) ( data + sizeof( TCB* ) + sizeof( T1 ) ) );
-		const T3 v3 = *( ( T3* ) ( data + sizeof( TCB* ) + sizeof( T1 ) + sizeof( T2 ) ) );
-		const T4 v4 = *( ( T4* ) ( data + sizeof( TCB* ) + sizeof( T1 ) + sizeof( T2 ) + sizeof( T3 ) ) );
-		const T5 v5 = *( ( T5* ) ( data + sizeof( TCB* ) + sizeof( T1 ) + sizeof( T2 ) + sizeof( T3 ) + sizeof( T4 ) ) );
-		function( v1, v2, v3, v4, v5 );
-	}
-	template< typename TCB, typename T1, typename T2, typename T3, typename T4, typename T5, typename T6 >
-	static void executeStubV6( char* data )
-	{
-		const TCB function = *( ( TCB* ) data );
-		const T1 v1 = *( ( T1* ) ( data + sizeof( TCB* ) ) );
-		const T2 v2 = *( ( T2* ) ( data + sizeof( TCB* ) + sizeof( T1 ) ) );
-		const T3 v3 = *( ( T3* ) ( data + sizeof( TCB* ) + sizeof( T1 ) + sizeof( T2 ) ) );
-		const T4 v4 = *( ( T4* ) ( data + sizeof( TCB* ) + sizeof( T1 ) + sizeof( T2 ) + sizeof( T3 ) ) );
-		const T5 v5 = *( ( T5* ) ( data + sizeof( TCB* ) + sizeof( T1 ) + sizeof( T2 ) + sizeof( T3 ) + sizeof( T4 ) ) );
-		const T6 v6 = *( ( T6* ) ( data + sizeof( TCB* ) + sizeof( T1 ) + sizeof( T2 ) + sizeof( T3 ) + sizeof( T4 ) + sizeof( T5 ) ) );
-		function( v1, v2, v3, v4, v5, v6 );
+		if ( handler_key_t< F >::value )
+			*( ( uint32_t* ) ( data - COMMAND_HEADER + sizeof( PFNCommandHandler* ) ) ) |= COMMAND_KEYED;
 	}
+	#endif
 
 
 	//
-	//		returns() Stub functions																	//	These are the `stub` functions that actually CALL YOUR function and returns the value directly to the address you specified! These are the functions that are actually called on another thread! They are called directly by the thread inner-loop!
+	//		enqueue()																					//	All the execute(), returns() and try_execute() functions end up here! Writes the stub, your function pointer and the parameters to the queue
 	//
-	template< typename TCB, typename R >
-	static void returnStubV0( char* data )
+	template< typename TStub, typename F, typename... T >
+	uint64_t enqueue( const Reserve mode, const TStub stub, F&& function, T&&... v )					//	Returns the ticket of the command, or 0 when it was NOT written (a full RingBackend)
 	{
-		const TCB function = *( ( TCB* ) data );
-		**( ( R* ) ( data + sizeof( TCB* ) ) ) = function();
+		handle_t buffer = acquireBuffer();
+		const bool written = this->write( buffer, mode, stub, std::forward< F >( function ), std::forward< T >( v )... );
+		const uint64_t ticket = releaseBuffer( buffer, written ? 1 : 0 );
+		return written ? ticket : 0;
 	}
-	template< typename TCB, typename R, typename T1 >
-	static void returnStubV1( char* data )
+
+
+	//
+	//		write()																						//	enqueue() without the acquire/release ... the caller already holds `buffer`, see BatchWriter! Returns false when the command was NOT written, and then nothing was moved out of the parameters!
+	//
+	template< typename TStub, typename F, typename... T >
+	bool write( handle_t buffer, const Reserve mode, const TStub stub, F&& function, T&&... v )
 	{
-		const TCB function = *( ( TCB* ) data );
-		const T1 v1 = *( ( T1* ) ( data + sizeof( TCB* ) + sizeof( R ) ) );
-		**( ( R* ) ( data + sizeof( TCB* ) ) ) = function( v1 );
+		typedef args_layout_t< 0, typename std::decay< F >::type, typename std::decay< T >::type... > layout_t;	//	A function pointer (or the type of your lambda/functor object), followed by the parameters ... EXACTLY the layout the stub expects!
+
+		static_assert( commandSize( layout_t::size ) <= TBackend::maxCommand, "The parameters don't fit in a command of this backend, use a bigger RingBackend< N > (a command can use half the ring) or pass a pointer" );
+
+		char* data = allocCommand( buffer, stub, layout_t::size, mode );								//	`function` pointer address (or the whole lambda object) AND all the parameters are written to the queue buffer!
+		if ( data == nullptr )																			//	nullptr == the queue is full, and the backend dropped the command!
+			return false;
+		#if defined(COMMANDQUEUE_ENABLE_PROFILING)
+		markHandler< typename std::decay< F >::type >( data );
+		#endif
+
+		layout_t::construct( data, std::forward< F >( function ), std::forward< T >( v )... );		//	Here we actually WRITE the function pointer and the parameters, the line above just allocates/reserves space on the queue, like malloc() it returns a pointer to the `data` section in the queue, of `size` bytes!
+		return true;
 	}
-	template< typename TCB, typename R, typename T1, typename T2 >
-	static void returnStubV2( char* data )
+
+
+public:
+	//
+	//		constructors
+	//
+	BasicCommandQueue() { this->init( CommandQueueOptions() ); }
+	BasicCommandQueue( const uint32_t size ) { CommandQueueOptions options; options.size = size; this->init( options ); }
+	BasicCommandQueue( const CommandQueueOptions& options ) { this->init( options ); }				//	Pin the command thread, put its buffers on a NUMA node etc. ... see CommandQueueOptions
+	~BasicCommandQueue()																				//	Shutdown thread, the backend frees the buffers
 	{
-		const TCB function = *( ( TCB* ) data );
-		const T1 v1 = *( ( T1* ) ( data + sizeof( TCB* ) + sizeof( R ) ) );
-		const T2 v2 = *( ( T2* ) ( data + sizeof( TCB* ) + sizeof( R ) + sizeof( T1 ) ) );
-		**( ( R* ) ( data + sizeof( TCB* ) ) ) = function( v1, v2 );
+		this->shutdown = true;
+		this->wakeConsumer();
+		this->hThread->join();
+		delete this->hThread;
 	}
-	template< typename TCB, typename R, typename T1, typename T2, typename T3 >
-	static void returnStubV3( char* data )
+
+
+	//
+	//		execute()																					//	Includes a `parameter` stub function which extracts the parameters for you from the buffer! There is an advanced access directly to the data buffer with rawExecute, it's slightly faster because your data doesn't pass through the stub function, but it's a bit harder to work with! This is more convenient!
+	//
+	template< typename F >																				//	Functions, lambdas (WITH captures!) and functor objects ... the whole lambda object is stored inline in the queue buffer, so there is no heap allocation like std::function!
+	uint64_t execute( F&& function )																	//	Returns a ticket, see wait_until() ... 0 when a full RingBackend< N, OverflowPolicy::Drop > dropped it
 	{
-		const TCB function = *( ( TCB* ) data );
-		const T1 v1 = *( ( T1* ) ( data + sizeof( TCB* ) + sizeof( R ) ) );
-		const T2 v2 = *( ( T2* ) ( data + sizeof( TCB* ) + sizeof( R ) + sizeof( T1 ) ) );
-		const T3 v3 = *( ( T3* ) ( data + sizeof( TCB* ) + sizeof( R ) + sizeof( T1 ) + sizeof( T2 ) ) );
-		**( ( R* ) ( data + sizeof( TCB* ) ) ) = function( v1, v2, v3 );
+		return this->enqueue( Reserve::Policy, executeStub< typename std::decay< F >::type >, std::forward< F >( function ) );
 	}
-	template< typename TCB, typename R, typename T1, typename T2, typename T3, typename T4 >
-	static void returnStubV4( char* data )
+	template< typename TCB, typename T1, typename... T >												//	Any number of parameters! Pass big objects with std::move() and they are moved directly into the queue buffer!
+	uint64_t execute( TCB&& function, T1&& v1, T&&... v )
 	{
-		const TCB function = *( ( TCB* ) data );
-		const T1 v1 = *( ( T1* ) ( data + sizeof( TCB* ) + sizeof( R ) ) );
-		const T2 v2 = *( ( T2* ) ( data + sizeof( TCB* ) + sizeof( R ) + sizeof( T1 ) ) );
-		const T3 v3 = *( ( T3* ) ( data + sizeof( TCB* ) + sizeof( R ) + sizeof( T1 ) + sizeof( T2 ) ) );
-		const T4 v4 = *( ( T4* ) ( data + sizeof( TCB* ) + sizeof( R ) + sizeof( T1 ) + sizeof( T2 ) + sizeof( T3 ) ) );
-		**( ( R* ) ( data + sizeof( TCB* ) ) ) = function( v1, v2, v3, v4 );
+		return this->enqueue( Reserve::Policy, executeStub< typename std::decay< TCB >::type, typename std::decay< T1 >::type, typename std::decay< T >::type... >, std::forward< TCB >( function ), std::forward< T1 >( v1 ), std::forward< T >( v )... );
 	}
-	template< typename TCB, typename R, typename T1, typename T2, typename T3, typename T4, typename T5 >
-	static void returnStubV5( char* data )
+
+
+	//
+	//		try_execute()																				//	Same as execute(), but NEVER waits for space in a bounded queue (RingBackend)! Returns false when the queue is full and the command was NOT added, it's up to you to try again later!
+	//
+	template< typename F >
+	bool try_execute( F&& function )
 	{
-		const TCB function = *( ( TCB* ) data );
-		const T1 v1 = *( ( T1* ) ( data + sizeof( TCB* ) + sizeof( R ) ) );
-		const T2 v2 = *( ( T2* ) ( data + sizeof( TCB* ) + sizeof( R ) + sizeof( T1 ) ) );
-		const T3 v3 = *( ( T3* ) ( data + sizeof( TCB* ) + sizeof( R ) + sizeof( T1 ) + sizeof( T2 ) ) );
-		const T4 v4 = *( ( T4* ) ( data + sizeof( TCB* ) + sizeof( R ) + sizeof( T1 ) + sizeof( T2 ) + sizeof( T3 ) ) );
-		const T5 v5 = *( ( T5* ) ( data + sizeof( TCB* ) + sizeof( R ) + sizeof( T1 ) + sizeof( T2 ) + sizeof( T3 ) + sizeof( T4 ) ) );
-		**( ( R* ) ( data + sizeof( TCB* ) ) ) = function( v1, v2, v3, v4, v5 );
+		return this->enqueue( Reserve::Fail, executeStub< typename std::decay< F >::type >, std::forward< F >( function ) ) != 0;
 	}
-	template< typename TCB, typename R, typename T1, typename T2, typename T3, typename T4, typename T5, typename T6 >
-	static void returnStubV6( char* data )
+	template< typename TCB, typename T1, typename... T >
+	bool try_execute( TCB&& function, T1&& v1, T&&... v )												//	NOTE: When it returns false, nothing was moved out of your parameters!
 	{
-		const TCB function = *( ( TCB* ) data );
-		const T1 v1 = *( ( T1* ) ( data + sizeof( TCB* ) + sizeof( R ) ) );
-		const T2 v2 = *( ( T2* ) ( data + sizeof( TCB* ) + sizeof( R ) + sizeof( T1 ) ) );
-		const T3 v3 = *( ( T3* ) ( data + sizeof( TCB* ) + sizeof( R ) + sizeof( T1 ) + sizeof( T2 ) ) );
-		const T4 v4 = *( ( T4* ) ( data + sizeof( TCB* ) + sizeof( R ) + sizeof( T1 ) + sizeof( T2 ) + sizeof( T3 ) ) );
-		const T5 v5 = *( ( T5* ) ( data + sizeof( TCB* ) + sizeof( R ) + sizeof( T1 ) + sizeof( T2 ) + sizeof( T3 ) + sizeof( T4 ) ) );
-		const T6 v6 = *( ( T6* ) ( data + sizeof( TCB* ) + sizeof( R ) + sizeof( T1 ) + sizeof( T2 ) + sizeof( T3 ) + sizeof( T4 ) + sizeof( T5 ) ) );
-		**( ( R* ) ( data + sizeof( TCB* ) ) ) = function( v1, v2, v3, v4, v5, v6 );
+		return this->enqueue( Reserve::Fail, executeStub< typename std::decay< TCB >::type, typename std::decay< T1 >::type, typename std::decay< T >::type... >, std::forward< TCB >( function ), std::forward< T1 >( v1 ), std::forward< T >( v )... ) != 0;
 	}
 
 
-public:
 	//
-	//		constructors
+	//		returns()																					//	See async() below, it's the better option! We store the return address directly after the function pointer address, the `stub` functions are what actually call your function, they are the ones that are actually executed on another thread!
 	//
-	CommandQueue() { this->init( 256 ); }
-	CommandQueue( const uint32_t size ) { this->init( size ); }
-	~CommandQueue()																						//	Shutdown thread
+	template< typename TCB, typename R, typename... T >
+	uint64_t returns( TCB&& function, const R ret, T&&... v )
 	{
-		this->shutdown = true;
-		this->cvDequeue.notify_one();
-		this->hThread->join();
-		free( this->buffer[ 0 ].commands );
-		free( this->buffer[ 1 ].commands );
+		return this->enqueue( Reserve::Policy, returnStub< typename std::decay< TCB >::type, R, typename std::decay< T >::type... >, std::forward< TCB >( function ), ret, std::forward< T >( v )... );	//	We store the return address on our internal data buffer, directly after the function call address
 	}
 
 
 	//
-	//		execute()																					//	Includes a `parameter` stub function which extracts the parameters for you from the buffer! There is an advanced access directly to the data buffer with rawExecute, it's slightly faster because your data doesn't pass through the stub function, but it's a bit harder to work with! This is more convenient!
+	//		async()																						//	Like returns(), but you get a `future` back instead of passing a raw pointer, so you can wait for THIS result only, not the whole queue like join()!
 	//
-	/*
-	template< typename TCB >																			//	TCB = Type(name)/Template Callback
-	void execute( const TCB function )
+private:
+	template< typename R, typename F >
+	struct async_call_t																					//	The command we actually queue: calls your function, writes the result into the slot and wakes up anybody waiting on it
 	{
-		queue_buffer_t* buffer = acquireBuffer();
+		F						function;																//	FIRST, so a plain function pointer is what the profile sees ... see handler_key_t
+		BasicCommandQueue*		commandQ;
+		future_state_t< R, memory_t >*	state;
 
-		*( ( TCB* ) allocCommand( buffer, executeStubV0< TCB >, sizeof( PFNCommandHandler* ) + sizeof( TCB* ) ) ) = function;						//	`function` pointer address is written to the queue buffer, allocCommand() returns a memory address for use to write the `function` address/pointer
-
-		releaseBuffer( buffer );
-	}
-	*/
-	void execute( void (*function)() )																	//	This function is not like the rest! This uses a hard-coded function declaration, so we can easily support anonymous lambda functions that don't return anything! Lambda functions cannot use templates, so we removed the template from this one!
+		template< typename... A >
+		void operator()( A&&... a )
+		{
+			this->state->value.set( this->function, std::forward< A >( a )... );
+			this->commandQ->complete( this->state );
+			this->state->release();
+		}
+	};
+	template< typename R, typename G >
+	struct then_call_t : continuation_t																	//	then() ... NOT a command in the queue! It hangs on the state of the previous command, and complete() runs it, so it can never overtake that command (StagingBuffers don't order commands from different threads!)
 	{
-		queue_buffer_t* buffer = acquireBuffer();
+		typedef typename then_result_t< G, R >::type result_t;
+		typedef node_pool_t< then_call_t, memory_t > pool_t;											//	Recycled nodes, see node_pool_t
 
-		typedef void (*function_t)();
-		*( ( function_t* ) allocCommand( buffer, executeStubV0< function_t >, sizeof( PFNCommandHandler* ) + sizeof( function_t* ) ) ) = function;	//	`function` pointer address is written to the queue buffer, allocCommand() returns a memory address for use to write the `function` address/pointer
+		BasicCommandQueue*		commandQ;
+		future_state_t< R, memory_t >*	source;
+		future_state_t< result_t, memory_t >*	state;
+		G						function;
 
-		releaseBuffer( buffer );
-	}
-	template< typename TCB, typename T1 >
-	void execute( const TCB function, const T1 v1 )
-	{
-		queue_buffer_t* buffer = acquireBuffer();
+		template< typename F >
+		then_call_t( BasicCommandQueue* commandQ, future_state_t< R, memory_t >* source, future_state_t< result_t, memory_t >* state, F&& function ) : commandQ( commandQ ), source( source ), state( state ), function( std::forward< F >( function ) )
+		{
+			this->run = &then_call_t::resume;
+		}
 
-		char* data = allocCommand( buffer, executeStubV1< TCB, T1 >, sizeof( PFNCommandHandler* ) + sizeof( TCB* ) + sizeof( T1 ) );				//	`function` pointer address AND T1 parameter is written to the queue buffer!
-		*( ( TCB* ) data ) = function;																												//	Here we actually WRITE the function pointer, the line above just allocates/reserves space on the queue, like malloc() it returns a pointer to the `data` section in the queue, of `size` bytes!
-		*( ( T1* ) ( data + sizeof( TCB* ) ) ) = v1;																								//	This is where we actually write the parameter to the queue buffer, We do some pointer addition, to move to the next parameter
+		result_t operator()()
+		{
+			return this->source->value.apply( this->function );
+		}
 
-		releaseBuffer( buffer );
-	}
-	template< typename TCB, typename T1, typename T2 >
-	void execute( const TCB function, const T1 v1, const T2 v2 )
-	{
-		queue_buffer_t* buffer = acquireBuffer();
+		static void resume( continuation_t* continuation )												//	Command thread! The previous command has completed
+		{
+			then_call_t* call = static_cast< then_call_t* >( continuation );
+			BasicCommandQueue* commandQ = call->commandQ;
+			future_state_t< result_t, memory_t >* state = call->state;
 
-		char* data = allocCommand( buffer, executeStubV2< TCB, T1, T2 >, sizeof( PFNCommandHandler* ) + sizeof( TCB* ) + sizeof( T1 ) + sizeof( T2 ) );
-		*( ( TCB* ) data ) = function;
-		*( ( T1* ) ( data + sizeof( TCB* ) ) ) = v1;
-		*( ( T2* ) ( data + sizeof( TCB* ) + sizeof( T1 ) ) ) = v2;
+			state->value.set( *call );
+			call->source->release();																	//	AFTER the continuation returned, it might have just moved the result out!
+			call->~then_call_t();
+			pool_t::free( call );
 
-		releaseBuffer( buffer );
-	}
-	template< typename TCB, typename T1, typename T2, typename T3 >
-	void execute( const TCB function, const T1 v1, const T2 v2, const T3 v3 )
+			commandQ->complete( state );																//	... which runs the next then() in the chain
+			state->release();
+		}
+	};
+	template< typename R, typename G >
+	struct continue_call_t																				//	The command for a then() that came too late, the result was already there ... one stub per continuation type, so the profile can tell them apart
 	{
-		queue_buffer_t* buffer = acquireBuffer();
+		uintptr_t				key;																	//	YOUR function pointer, when the continuation is a plain function ... see handler_key_t
+		then_call_t< R, G >*	call;
 
-		char* data = allocCommand( buffer, executeStubV3< TCB, T1, T2, T3 >, sizeof( PFNCommandHandler* ) + sizeof( TCB* ) + sizeof( T1 ) + sizeof( T2 ) + sizeof( T3 ) );
-		*( ( TCB* ) data ) = function;
-		*( ( T1* ) ( data + sizeof( TCB* ) ) ) = v1;
-		*( ( T2* ) ( data + sizeof( TCB* ) + sizeof( T1 ) ) ) = v2;
-		*( ( T3* ) ( data + sizeof( TCB* ) + sizeof( T1 ) + sizeof( T2 ) ) ) = v3;
+		void operator()() { then_call_t< R, G >::resume( this->call ); }
 
-		releaseBuffer( buffer );
-	}
-	template< typename TCB, typename T1, typename T2, typename T3, typename T4 >
-	void execute( const TCB function, const T1 v1, const T2 v2, const T3 v3, const T4 v4 )
+		static uintptr_t handler( const G& function, std::true_type ) { return ( uintptr_t ) function; }
+		static uintptr_t handler( const G&, std::false_type ) { return 0; }
+	};
+	template< typename F >
+	struct handler_key_t																				//	true when the data section of a command with this function object starts with YOUR function pointer ... see markHandler()
 	{
-		queue_buffer_t* buffer = acquireBuffer();
-
-		char* data = allocCommand( buffer, executeStubV4< TCB, T1, T2, T3, T4 >, sizeof( PFNCommandHandler* ) + sizeof( TCB* ) + sizeof( T1 ) + sizeof( T2 ) + sizeof( T3 ) + sizeof( T4 ) );
-		*( ( TCB* ) data ) = function;
-		*( ( T1* ) ( data + sizeof( TCB* ) ) ) = v1;
-		*( ( T2* ) ( data + sizeof( TCB* ) + sizeof( T1 ) ) ) = v2;
-		*( ( T3* ) ( data + sizeof( TCB* ) + sizeof( T1 ) + sizeof( T2 ) ) ) = v3;
-		*( ( T4* ) ( data + sizeof( TCB* ) + sizeof( T1 ) + sizeof( T2 ) + sizeof( T3 ) ) ) = v4;
+		static const bool value = std::is_pointer< F >::value && std::is_function< typename std::remove_pointer< F >::type >::value;
+	};
+	template< typename R, typename F >
+	struct handler_key_t< async_call_t< R, F > > : handler_key_t< F > {};
+	template< typename R, typename G >
+	struct handler_key_t< continue_call_t< R, G > > : handler_key_t< G > {};
 
-		releaseBuffer( buffer );
+	void complete( future_base_t* state )																//	Called on the command thread
+	{
+		state->done.store( true );																		//	seq_cst! Either we see `waiting`, or wait() sees `done` ... never neither!
+		if ( state->waiting.load() )
+		{
+			std::lock_guard<std::mutex> lock( this->mtxFuture );										//	Under the lock, otherwise wait() can test `done` and go to sleep just before we notify it!
+			this->cvFuture.notify_all();
+		}
+		continuation_t* continuation = state->continuation.exchange( future_base_t::finished() );	//	AFTER the result was written ... either then() attached its continuation before this, or it sees finished() and queues it itself
+		if ( continuation )
+			continuation->run( continuation );
 	}
-	template< typename TCB, typename T1, typename T2, typename T3, typename T4, typename T5 >
-	void execute( const TCB function, const T1 v1, const T2 v2, const T3 v3, const T4 v4, const T5 v5 )
+	void waitFor( future_base_t* state )																//	NEVER call this from inside a command, it would wait for itself!
 	{
-		queue_buffer_t* buffer = acquireBuffer();
-
-		char* data = allocCommand( buffer, executeStubV5< TCB, T1, T2, T3, T4, T5 >, sizeof( PFNCommandHandler* ) + sizeof( TCB* ) + sizeof( T1 ) + sizeof( T2 ) + sizeof( T3 ) + sizeof( T4 ) + sizeof( T5 ) );
-		*( ( TCB* ) data ) = function;
-		*( ( T1* ) ( data + sizeof( TCB* ) ) ) = v1;
-		*( ( T2* ) ( data + sizeof( TCB* ) + sizeof( T1 ) ) ) = v2;
-		*( ( T3* ) ( data + sizeof( TCB* ) + sizeof( T1 ) + sizeof( T2 ) ) ) = v3;
-		*( ( T4* ) ( data + sizeof( TCB* ) + sizeof( T1 ) + sizeof( T2 ) + sizeof( T3 ) ) ) = v4;
-		*( ( T5* ) ( data + sizeof( TCB* ) + sizeof( T1 ) + sizeof( T2 ) + sizeof( T3 ) + sizeof( T4 ) ) ) = v5;
-
-		releaseBuffer( buffer );
+		for ( uint32_t spin = 0; spin < 256; spin++ )													//	Most results are ready very quickly, so we spin for a moment before going to sleep!
+			if ( state->done.load( std::memory_order_acquire ) )
+				return;
+		state->waiting.store( true );
+		std::unique_lock<std::mutex> lock( this->mtxFuture );
+		this->cvFuture.wait( lock, [state] { return state->done.load( std::memory_order_acquire ); } );
 	}
-	template< typename TCB, typename T1, typename T2, typename T3, typename T4, typename T5, typename T6 >
-	void execute( const TCB function, const T1 v1, const T2 v2, const T3 v3, const T4 v4, const T5 v5, const T6 v6 )
+
+public:
+	template< typename R >
+	class future																						//	Move-only, like std::future ... but no heap allocation, no shared_ptr and no exceptions!
 	{
-		queue_buffer_t* buffer = acquireBuffer();
+		friend class BasicCommandQueue;
 
-		char* data = allocCommand( buffer, executeStubV6< TCB, T1, T2, T3, T4, T5, T6 >, sizeof( PFNCommandHandler* ) + sizeof( TCB* ) + sizeof( T1 ) + sizeof( T2 ) + sizeof( T3 ) + sizeof( T4 ) + sizeof( T5 ) + sizeof( T6 ) );
-		*( ( TCB* ) data ) = function;
-		*( ( T1* ) ( data + sizeof( TCB* ) ) ) = v1;
-		*( ( T2* ) ( data + sizeof( TCB* ) + sizeof( T1 ) ) ) = v2;
-		*( ( T3* ) ( data + sizeof( TCB* ) + sizeof( T1 ) + sizeof( T2 ) ) ) = v3;
-		*( ( T4* ) ( data + sizeof( TCB* ) + sizeof( T1 ) + sizeof( T2 ) + sizeof( T3 ) ) ) = v4;
-		*( ( T5* ) ( data + sizeof( TCB* ) + sizeof( T1 ) + sizeof( T2 ) + sizeof( T3 ) + sizeof( T4 ) ) ) = v5;
-		*( ( T6* ) ( data + sizeof( TCB* ) + sizeof( T1 ) + sizeof( T2 ) + sizeof( T3 ) + sizeof( T4 ) + sizeof( T5 ) ) ) = v6;
+		BasicCommandQueue*		commandQ;
+		future_state_t< R, memory_t >*	state;
 
-		releaseBuffer( buffer );
-	}
+		future( BasicCommandQueue* commandQ, future_state_t< R, memory_t >* state ) : commandQ( commandQ ), state( state ) {}
+	public:
+		future() : commandQ( nullptr ), state( nullptr ) {}
+		future( future&& other ) : commandQ( other.commandQ ), state( other.state ) { other.state = nullptr; }
+		future& operator =( future&& other )
+		{
+			if ( this != &other )
+			{
+				if ( this->state )
+					this->state->release();
+				this->commandQ = other.commandQ;
+				this->state = other.state;
+				other.state = nullptr;
+			}
+			return *this;
+		}
+		future( const future& ) = delete;
+		future& operator =( const future& ) = delete;
+		~future()																						//	You don't have to wait, the command still runs and the slot is returned to the pool when it's done!
+		{
+			if ( this->state )
+				this->state->release();
+		}
 
+		bool valid() const	{ return this->state != nullptr; }											//	false when default constructed, or after then() consumed the future!
+		bool ready() const	{ return this->state->done.load( std::memory_order_acquire ); }				//	Never blocks!
+		void wait() const	{ this->commandQ->waitFor( this->state ); }									//	Blocks until THIS command has executed, the rest of the queue can keep going!
+		R get()				{ this->wait(); return this->state->value.take(); }							//	wait() + MOVES the result out, so only call it once! Returns void for async() on a void function
 
-	//
-	//		returns()																					//	We store the return address directly after the function pointer address, the `stub` functions are what actually call your function, they are the ones that are actually executed on another thread!
-	//
-	template< typename TCB, typename R >
-	void returns( const TCB function, const R ret )
-	{
-		queue_buffer_t* buffer = acquireBuffer();
+		template< typename G >																			//	Runs `function( result )` on the command thread, directly after this command ... from ANY thread, with any backend. This future is consumed (!valid()), use the future you get back!
+		future< typename then_result_t< typename std::decay< G >::type, R >::type > then( G&& function )
+		{
+			typedef then_call_t< R, typename std::decay< G >::type > call_t;
+			typedef typename call_t::result_t result_t;
+			static_assert( alignof( call_t ) <= COMMAND_ALIGNMENT, "The continuation needs more alignment than the memory policy gives its nodes" );
 
-		char* data = allocCommand( buffer, returnStubV0< TCB, R >, sizeof( PFNCommandHandler* ) + sizeof( TCB* ) + sizeof( R ) );
-		*( ( TCB* ) data ) = function;
-		*( ( R* ) ( data + sizeof( TCB* ) ) ) = ret;													//	We store the return address on our internal data buffer, directly after the function call address
+			future_state_t< result_t, memory_t >* state = future_state_t< result_t, memory_t >::acquire();
+			call_t* call = new ( call_t::pool_t::allocate() ) call_t( this->commandQ, this->state, state, std::forward< G >( function ) );
+			this->state = nullptr;																		//	The continuation owns our reference now
 
-		releaseBuffer( buffer );
-	}
-	template< typename TCB, typename R, typename T1 >
-	void returns( const TCB function, const R ret, const T1 v1 )
-	{
-		queue_buffer_t* buffer = acquireBuffer();
+			continuation_t* expected = nullptr;
+			if ( !call->source->continuation.compare_exchange_strong( expected, call ) )				//	The command already completed (expected == finished()), the result is ready, so just queue the continuation like any other command
+			{
+				typedef continue_call_t< R, typename std::decay< G >::type > continue_t;
+				const uintptr_t key = continue_t::handler( call->function, std::integral_constant< bool, handler_key_t< typename std::decay< G >::type >::value >() );
+				this->commandQ->enqueue( Reserve::Wait, executeStub< continue_t >, continue_t{ key, call } );
+			}
+			return future< result_t >( this->commandQ, state );
+		}
+	};
 
-		char* data = allocCommand( buffer, returnStubV1< TCB, R, T1 >, sizeof( PFNCommandHandler* ) + sizeof( TCB* ) + sizeof( R ) + sizeof( T1 ) );
-		*( ( TCB* ) data ) = function;
-		*( ( R* ) ( data + sizeof( TCB* ) ) ) = ret;
-		*( ( T1* ) ( data + sizeof( TCB* ) + sizeof( R ) ) ) = v1;
+	template< typename F, typename... T >
+	future< typename async_result_t< typename std::decay< F >::type, T... >::type > async( F&& function, T&&... v )
+	{
+		typedef typename std::decay< F >::type function_t;
+		typedef typename async_result_t< function_t, T... >::type R;
+		typedef async_call_t< R, function_t > call_t;
 
-		releaseBuffer( buffer );
+		future_state_t< R, memory_t >* state = future_state_t< R, memory_t >::acquire();
+		this->enqueue( Reserve::Wait, executeStub< call_t, typename std::decay< T >::type... >, call_t{ std::forward< F >( function ), this, state }, std::forward< T >( v )... );	//	Reserve::Wait ... somebody is waiting for this one, so it's NEVER dropped!
+		return future< R >( this, state );
 	}
-	template< typename TCB, typename R, typename T1, typename T2 >
-	void returns( const TCB function, const R ret, const T1 v1, const T2 v2 )
-	{
-		queue_buffer_t* buffer = acquireBuffer();
 
-		char* data = allocCommand( buffer, returnStubV2< TCB, R, T1, T2 >, sizeof( PFNCommandHandler* ) + sizeof( TCB* ) + sizeof( R ) + sizeof( T1 ) + sizeof( T2 ) );
-		*( ( TCB* ) data ) = function;
-		*( ( R* ) ( data + sizeof( TCB* ) ) ) = ret;
-		*( ( T1* ) ( data + sizeof( TCB* ) + sizeof( R ) ) ) = v1;
-		*( ( T2* ) ( data + sizeof( TCB* ) + sizeof( R ) + sizeof( T1 ) ) ) = v2;
 
-		releaseBuffer( buffer );
-	}
-	template< typename TCB, typename R, typename T1, typename T2, typename T3 >
-	void returns( const TCB function, const R ret, const T1 v1, const T2 v2, const T3 v3 )
+	//
+	//		BatchWriter																					//	Holds the buffer for MANY commands! One acquire, and ONE release + (at most) one wake up of the command thread when it goes out of scope, instead of one per command
+	//
+	class BatchWriter																					//	NOTE: Other producers (and the command thread on the DoubleBuffer) wait for you while you hold the buffer, so fill it and let it go! Don't call commandQ.execute() while you hold it, use the writer!
 	{
-		queue_buffer_t* buffer = acquireBuffer();
+		BasicCommandQueue&	commandQ;
+		handle_t			buffer;
+		uint32_t			commands = 0;																//	Written since the last release, they all get their own ticket ... see pending()
+
+		template< typename TStub, typename F, typename... T >
+		bool write( const Reserve mode, const TStub stub, F&& function, T&&... v )
+		{
+			if ( !this->commandQ.write( this->buffer, Reserve::Fail, stub, std::forward< F >( function ), std::forward< T >( v )... ) )	//	Never waits! The DoubleBuffer and StagingBuffers never fail, they grow
+			{
+				this->flush();																			//	A bounded queue (RingBackend) is full! We MUST publish what we have, the command thread can't make space from commands it can't see ... nothing was moved out of the parameters yet, so it's safe to forward them again!
+				if ( !this->commandQ.write( this->buffer, mode, stub, std::forward< F >( function ), std::forward< T >( v )... ) )
+					return false;
+			}
+			this->commands++;
+			return true;
+		}
 
-		char* data = allocCommand( buffer, returnStubV3< TCB, R, T1, T2, T3 >, sizeof( PFNCommandHandler* ) + sizeof( TCB* ) + sizeof( R ) + sizeof( T1 ) + sizeof( T2 ) + sizeof( T3 ) );
-		*( ( TCB* ) data ) = function;
-		*( ( R* ) ( data + sizeof( TCB* ) ) ) = ret;
-		*( ( T1* ) ( data + sizeof( TCB* ) + sizeof( R ) ) ) = v1;
-		*( ( T2* ) ( data + sizeof( TCB* ) + sizeof( R ) + sizeof( T1 ) ) ) = v2;
-		*( ( T3* ) ( data + sizeof( TCB* ) + sizeof( R ) + sizeof( T1 ) + sizeof( T2 ) ) ) = v3;
+	public:
+		BatchWriter( BasicCommandQueue& commandQ ) : commandQ( commandQ ), buffer( commandQ.acquireBuffer() ) {}
+		~BatchWriter() { if ( this->buffer ) this->commandQ.releaseBuffer( this->buffer, this->commands ); }
+		BatchWriter( const BatchWriter& ) = delete;
+		BatchWriter& operator =( const BatchWriter& ) = delete;
 
-		releaseBuffer( buffer );
-	}
-	template< typename TCB, typename R, typename T1, typename T2, typename T3, typename T4 >
-	void returns( const TCB function, const R ret, const T1 v1, const T2 v2, const T3 v3, const T4 v4 )
-	{
-		queue_buffer_t* buffer = acquireBuffer();
+		uint64_t flush()																				//	Publishes everything written so far, and keeps writing ... returns the ticket of everything published so far
+		{
+			const uint64_t ticket = this->commandQ.releaseBuffer( this->buffer, this->commands );
+			this->buffer = this->commandQ.acquireBuffer();
+			this->commands = 0;
+			return ticket;
+		}
+		uint64_t close()																				//	Publishes everything and lets go of the buffer, you can't write anymore after this!
+		{
+			const uint64_t ticket = this->commandQ.releaseBuffer( this->buffer, this->commands );
+			this->buffer = nullptr;
+			this->commands = 0;
+			return ticket;
+		}
 
-		char* data = allocCommand( buffer, returnStubV4< TCB, R, T1, T2, T3, T4 >, sizeof( PFNCommandHandler* ) + sizeof( TCB* ) + sizeof( R ) + sizeof( T1 ) + sizeof( T2 ) + sizeof( T3 ) + sizeof( T4 ) );
-		*( ( TCB* ) data ) = function;
-		*( ( R* ) ( data + sizeof( TCB* ) ) ) = ret;
-		*( ( T1* ) ( data + sizeof( TCB* ) + sizeof( R ) ) ) = v1;
-		*( ( T2* ) ( data + sizeof( TCB* ) + sizeof( R ) + sizeof( T1 ) ) ) = v2;
-		*( ( T3* ) ( data + sizeof( TCB* ) + sizeof( R ) + sizeof( T1 ) + sizeof( T2 ) ) ) = v3;
-		*( ( T4* ) ( data + sizeof( TCB* ) + sizeof( R ) + sizeof( T1 ) + sizeof( T2 ) + sizeof( T3 ) ) ) = v4;
+		template< typename F, typename... T >
+		void execute( F&& function, T&&... v )
+		{
+			this->write( Reserve::Policy, executeStub< typename std::decay< F >::type, typename std::decay< T >::type... >, std::forward< F >( function ), std::forward< T >( v )... );
+		}
+		template< typename F, typename... T >
+		bool try_execute( F&& function, T&&... v )
+		{
+			return this->write( Reserve::Fail, executeStub< typename std::decay< F >::type, typename std::decay< T >::type... >, std::forward< F >( function ), std::forward< T >( v )... );
+		}
+		template< typename F, typename... T >
+		BatchWriter & operator ()( F&& function, T&&... v ) { this->execute( std::forward< F >( function ), std::forward< T >( v )... ); return *this; }
+	};
 
-		releaseBuffer( buffer );
-	}
-	template< typename TCB, typename R, typename T1, typename T2, typename T3, typename T4, typename T5 >
-	void returns( const TCB function, const R ret, const T1 v1, const T2 v2, const T3 v3, const T4 v4, const T5 v5 )
+	template< typename F >
+	uint64_t batch( F&& function )																		//	commandQ.batch( [&]( CommandQueue::BatchWriter& b ) { for ( ... ) b.execute( cmdDraw, sprite ); } );	... returns ONE ticket for the whole batch
 	{
-		queue_buffer_t* buffer = acquireBuffer();
+		BatchWriter writer( *this );
+		function( writer );
+		return writer.close();
+	}
 
-		char* data = allocCommand( buffer, returnStubV5< TCB, R, T1, T2, T3, T4, T5 >, sizeof( PFNCommandHandler* ) + sizeof( TCB* ) + sizeof( R ) + sizeof( T1 ) + sizeof( T2 ) + sizeof( T3 ) + sizeof( T4 ) + sizeof( T5 ) );
-		*( ( TCB* ) data ) = function;
-		*( ( R* ) ( data + sizeof( TCB* ) ) ) = ret;
-		*( ( T1* ) ( data + sizeof( TCB* ) + sizeof( R ) ) ) = v1;
-		*( ( T2* ) ( data + sizeof( TCB* ) + sizeof( R ) + sizeof( T1 ) ) ) = v2;
-		*( ( T3* ) ( data + sizeof( TCB* ) + sizeof( R ) + sizeof( T1 ) + sizeof( T2 ) ) ) = v3;
-		*( ( T4* ) ( data + sizeof( TCB* ) + sizeof( R ) + sizeof( T1 ) + sizeof( T2 ) + sizeof( T3 ) ) ) = v4;
-		*( ( T5* ) ( data + sizeof( TCB* ) + sizeof( R ) + sizeof( T1 ) + sizeof( T2 ) + sizeof( T3 ) + sizeof( T4 ) ) ) = v5;
 
-		releaseBuffer( buffer );
-	}
-	template< typename TCB, typename R, typename T1, typename T2, typename T3, typename T4, typename T5, typename T6 >
-	void returns( const TCB function, const R ret, const T1 v1, const T2 v2, const T3 v3, const T4 v4, const T5 v5, const T6 v6 )
+	//
+	//		rawExecute()																				//	These functions are slightly faster than execute(), but they don't extract the parameters from the queue. You get a `raw` pointer directly to data! This is for advanced use!
+	//
+	template< typename TCB, typename... T >
+	uint64_t rawExecute( const TCB function, T&&... v )													//	NOTE: Nobody destroys the parameters for you here! If you pass objects with a destructor, your function must call it!
 	{
-		queue_buffer_t* buffer = acquireBuffer();
+		static_assert( commandSize( packed_args_t< typename std::decay< T >::type... >::size ) <= TBackend::maxCommand, "The parameters don't fit in a command of this backend, use a bigger RingBackend< N > (a command can use half the ring) or pass a pointer" );
+		handle_t buffer = acquireBuffer();
 
-		char* data = allocCommand( buffer, returnStubV6< TCB, R, T1, T2, T3, T4, T5, T6 >, sizeof( PFNCommandHandler* ) + sizeof( TCB* ) + sizeof( R ) + sizeof( T1 ) + sizeof( T2 ) + sizeof( T3 ) + sizeof( T4 ) + sizeof( T5 ) + sizeof( T6 ) );
-		*( ( TCB* ) data ) = function;
-		*( ( R* ) ( data + sizeof( TCB* ) ) ) = ret;
-		*( ( T1* ) ( data + sizeof( TCB* ) + sizeof( R ) ) ) = v1;
-		*( ( T2* ) ( data + sizeof( TCB* ) + sizeof( R ) + sizeof( T1 ) ) ) = v2;
-		*( ( T3* ) ( data + sizeof( TCB* ) + sizeof( R ) + sizeof( T1 ) + sizeof( T2 ) ) ) = v3;
-		*( ( T4* ) ( data + sizeof( TCB* ) + sizeof( R ) + sizeof( T1 ) + sizeof( T2 ) + sizeof( T3 ) ) ) = v4;
-		*( ( T5* ) ( data + sizeof( TCB* ) + sizeof( R ) + sizeof( T1 ) + sizeof( T2 ) + sizeof( T3 ) + sizeof( T4 ) ) ) = v5;
-		*( ( T6* ) ( data + sizeof( TCB* ) + sizeof( R ) + sizeof( T1 ) + sizeof( T2 ) + sizeof( T3 ) + sizeof( T4 ) + sizeof( T5 ) ) ) = v6;
+		char* data = allocCommand( buffer, function, packed_args_t< typename std::decay< T >::type... >::size );
+		if ( data )
+			packArgs( data, std::forward< T >( v )... );
 
-		releaseBuffer( buffer );
+		const uint64_t ticket = releaseBuffer( buffer, data ? 1 : 0 );
+		return data ? ticket : 0;
 	}
 
 
 	//
-	//		rawExecute()																				//	These functions are slightly faster than execute(), but they don't extract the parameters from the queue. You get a `raw` pointer directly to data! This is for advanced use!
+	//		executeWithCopy()																			//	advanced! Copies the raw data directly to the buffer! You probably won't ever need it! It allows me to write raw data to the Command Queue buffers, for example, raw TCP/UDP data packets from the network!
 	//
 	template< typename TCB >
-	void rawExecute( const TCB function )
+	uint64_t rawExecuteWithCopy( const TCB function, const void* data, const uint32_t size )		//	Returns 0 when it was NOT written ... a full RingBackend< N, OverflowPolicy::Drop >, or `size` is more than half the ring
 	{
-		queue_buffer_t* buffer = acquireBuffer();
+		handle_t buffer = acquireBuffer();
 
-		allocCommand( buffer, function, 0 );
+		char* command = allocCommand( buffer, function, size );
+		if ( command )
+			::memcpy( command, data, size );
 
-		releaseBuffer( buffer );
+		const uint64_t ticket = releaseBuffer( buffer, command ? 1 : 0 );
+		return command ? ticket : 0;
 	}
-	template< typename TCB, typename T1 >
-	void rawExecute( const TCB function, const T1 v1 )
-	{
-		queue_buffer_t* buffer = acquireBuffer();
 
-		*( ( T1* ) allocCommand( buffer, function, sizeof( T1 ) ) ) = v1;
 
-		releaseBuffer( buffer );
-	}
-	template< typename TCB, typename T1, typename T2 >
-	void rawExecute( const TCB function, const T1 v1, const T2 v2 )
+	//
+	//		reserve() / commit()																		//	Zero-copy! reserve() gives you a `T` INSIDE the queue buffer (+ `extra` bytes directly behind it for a variable sized payload), you fill it in place, commit() publishes it. No temp buffer and no memcpy like rawExecuteWithCopy()!
+	//
+private:
+	template< typename TCB, typename T >
+	struct reserve_layout_t																				//	The data section: [ your handler ][ buffer handle, only used by commit() ][ T ][ extra bytes ] ... the handle is ALWAYS directly in front of T, so commit() can find it from your pointer!
 	{
-		queue_buffer_t* buffer = acquireBuffer();
+		static_assert( alignof( TCB ) <= COMMAND_HEADER && alignof( T ) <= COMMAND_ALIGNMENT, "Alignment too big for the command records, #define COMMANDQUEUE_RECORD_ALIGNMENT 64 before you include CommandQueue.hpp" );
 
-		char* data = allocCommand( buffer, function, sizeof( T1 ) + sizeof( T2 ) );
-		*( ( T1* ) data ) = v1;
-		*( ( T2* ) ( data + sizeof( T1 ) ) ) = v2;
+		static const uint32_t align = alignof( T ) > alignof( handle_t ) ? alignof( T ) : alignof( handle_t );
+		static const uint32_t object = ( ( COMMAND_HEADER + sizeof( TCB ) + sizeof( handle_t ) + align - 1 ) & ~( align - 1 ) ) - COMMAND_HEADER;
+		static const uint32_t handle = object - sizeof( handle_t );
+		static const uint32_t size = object + sizeof( T );
+	};
+	template< typename TCB, typename T >
+	static void reserveStub( char* data )
+	{
+		TCB& function = *( ( TCB* ) data );
+		T* object = ( T* ) ( data + reserve_layout_t< TCB, T >::object );
+		function( object );
+		object->~T();
+		function.~TCB();
+	}
+public:
+	template< typename T, typename F >
+	T* reserve( F&& function, const uint32_t extra = 0 )												//	NOTE: The buffer is HELD until you commit(), just like a BatchWriter ... NOTHING that blocks in between (recv(), file reads, locks), every other producer waits for you! And don't add any other commands from this thread in between! Returns nullptr when a full RingBackend< N, OverflowPolicy::Drop > dropped it (or `extra` is too big for the ring), then you must NOT commit()
+	{
+		typedef typename std::decay< F >::type function_t;												//	Called with a `T*` on the command thread, T is destroyed after it returns ... keep the size of your payload in T!
+		typedef reserve_layout_t< function_t, T > layout_t;
+		static_assert( commandSize( layout_t::size ) <= TBackend::maxCommand, "T doesn't fit in a command of this backend, use a bigger RingBackend< N > (a command can use half the ring)" );	//	`extra` is checked at run time, then you get nullptr
 
-		releaseBuffer( buffer );
+		handle_t buffer = acquireBuffer();
+		char* data = allocCommand( buffer, reserveStub< function_t, T >, layout_t::size + extra );
+		if ( data == nullptr )
+		{
+			releaseBuffer( buffer, 0 );
+			return nullptr;
+		}
+		#if defined(COMMANDQUEUE_ENABLE_PROFILING)
+		markHandler< function_t >( data );
+		#endif
+		new ( data ) function_t( std::forward< F >( function ) );
+		*( ( handle_t* ) ( data + layout_t::handle ) ) = buffer;										//	commit() only gets your pointer back, so we keep the handle right in front of it!
+		return new ( data + layout_t::object ) T;														//	Default initialised! A plain struct is NOT zeroed, you are about to fill it anyway
 	}
-	template< typename TCB, typename T1, typename T2, typename T3 >
-	void rawExecute( const TCB function, const T1 v1, const T2 v2, const T3 v3 )
+	template< typename T >
+	uint64_t commit( T* object )																		//	Returns the ticket of the command
 	{
-		queue_buffer_t* buffer = acquireBuffer();
+		return releaseBuffer( *( ( handle_t* ) ( ( char* ) object - sizeof( handle_t ) ) ) );
+	}
 
-		char* data = allocCommand( buffer, function, sizeof( T1 ) + sizeof( T2 ) + sizeof( T3 ) );
-		*( ( T1* ) data ) = v1;
-		*( ( T2* ) ( data + sizeof( T1 ) ) ) = v2;
-		*( ( T3* ) ( data + sizeof( T1 ) + sizeof( T2 ) ) )= v3;
 
-		releaseBuffer( buffer );
+	//
+	//		::SetEvent()
+	//
+	#if defined(_WIN32) && defined(HANDLE)
+protected:
+	void setEvent_cb( HANDLE** ev )																		//	Very useful for Windows development! Because you can use it for general purpose event notification! But join() is probably enough ... this could however send a notification to another thread to begin execution etc. join() locks the current thread, but maybe you want the current thread to continue and notify another thread somewhere else that a task is complete! It has come in handy before!
+	{
+		::SetEvent( *ev );
 	}
-	template< typename TCB, typename T1, typename T2, typename T3, typename T4 >
-	void rawExecute( const TCB function, const T1 v1, const T2 v2, const T3 v3, const T4 v4 )
+public:
+	void setEvent( HANDLE ev )
 	{
-		queue_buffer_t* buffer = acquireBuffer();
+		this->execute( setEvent_cb, ev );
+	}
+	#endif
 
-		char* data = allocCommand( buffer, function, sizeof( T1 ) + sizeof( T2 ) + sizeof( T3 ) + sizeof( T4 ) );
-		*( ( T1* ) data ) = v1;
-		*( ( T2* ) ( data + sizeof( T1 ) ) ) = v2;
-		*( ( T3* ) ( data + sizeof( T1 ) + sizeof( T2 ) ) )= v3;
-		*( ( T4* ) ( data + sizeof( T1 ) + sizeof( T2 ) + sizeof( T3 ) ) )= v4;
 
-		releaseBuffer( buffer );
+	//
+	//		tickets																						//	Every command gets the next ticket (a batch gets the ticket of its last command), and the command thread publishes the last ticket it has completed. Wait for ONE command instead of the whole queue!
+	//
+	uint64_t ticket()																					//	The ticket of everything published so far, by ALL threads ... wait_until( ticket() ) is a join(). StagingBuffers: by the calling thread, the tickets are per lane!
+	{
+		return this->backend.ticket();
 	}
-	template< typename TCB, typename T1, typename T2, typename T3, typename T4, typename T5 >
-	void rawExecute( const TCB function, const T1 v1, const T2 v2, const T3 v3, const T4 v4, const T5 v5 )
+	bool executed( const uint64_t ticket )																//	Never blocks! true when the command with this ticket (and everything published before it) has been executed
 	{
-		queue_buffer_t* buffer = acquireBuffer();
+		return this->backend.executed( ticket );
+	}
+	void wait_until( const uint64_t ticket )															//	NEVER call this from inside a command, it would wait for itself!
+	{
+		if ( this->spinUntil( ticket ) )
+			return;
+		std::unique_lock<std::mutex> lock( this->mtxTicket );
+		this->ticketWaiters++;
+		this->cvTicket.wait( lock, [&] { return this->backend.executed( ticket ); } );				//	seq_cst! See drain()
+		this->ticketWaiters--;
+	}
+	template< typename TClock, typename TDuration >
+	bool wait_until( const uint64_t ticket, const std::chrono::time_point< TClock, TDuration >& deadline )	//	Gives up at `deadline`, returns false when the command has NOT been executed yet ... it's still in the queue, wait again or check executed() later!
+	{
+		if ( this->spinUntil( ticket ) )
+			return true;
+		std::unique_lock<std::mutex> lock( this->mtxTicket );
+		this->ticketWaiters++;
+		const bool done = this->cvTicket.wait_until( lock, deadline, [&] { return this->backend.executed( ticket ); } );
+		this->ticketWaiters--;
+		return done;
+	}
+	template< typename TRep, typename TPeriod >
+	bool wait_for( const uint64_t ticket, const std::chrono::duration< TRep, TPeriod >& timeout )
+	{
+		return this->wait_until( ticket, std::chrono::steady_clock::now() + timeout );
+	}
+private:
+	bool spinUntil( const uint64_t ticket )
+	{
+		static const uint32_t spins = std::thread::hardware_concurrency() > 1 ? 64 + 16 : 0;			//	On a single core, spinning only delays the command thread we are waiting for, go straight to sleep!
+		for ( uint32_t spin = 0; spin < spins; spin++ )													//	The command thread publishes after every drain, so it's usually a matter of microseconds ... spin for a moment, then give up the core (the command thread might need it!) before going to sleep
+		{
+			if ( this->executed( ticket ) )
+				return true;
+			if ( spin < 64 )
+				cpuRelax();
+			else
+				std::this_thread::yield();
+		}
+		return this->executed( ticket );
+	}
+public:
 
-		char* data = allocCommand( buffer, function, sizeof( T1 ) + sizeof( T2 ) + sizeof( T3 ) + sizeof( T4 ) + sizeof( T5 ) );
-		*( ( T1* ) data ) = v1;
-		*( ( T2* ) ( data + sizeof( T1 ) ) ) = v2;
-		*( ( T3* ) ( data + sizeof( T1 ) + sizeof( T2 ) ) )= v3;
-		*( ( T4* ) ( data + sizeof( T1 ) + sizeof( T2 ) + sizeof( T3 ) ) )= v4;
-		*( ( T5* ) ( data + sizeof( T1 ) + sizeof( T2 ) + sizeof( T3 ) + sizeof( T4 ) ) )= v5;
 
-		releaseBuffer( buffer );
+	//
+	//		join																						//	Waits for everything published before the call, by any thread ... no command, no mutex and no wake up when the command thread is already done!
+	//
+	void join()																							//	One ticket per lane with StagingBuffers, otherwise just wait_until( ticket() )
+	{
+		this->backend.tickets( [this]( const uint64_t ticket ) { this->wait_until( ticket ); return true; } );
 	}
-	template< typename TCB, typename T1, typename T2, typename T3, typename T4, typename T5, typename T6 >
-	void rawExecute( const TCB function, const T1 v1, const T2 v2, const T3 v3, const T4 v4, const T5 v5, const T6 v6 )
+	bool try_join()																						//	Never blocks! true when everything published so far has been executed ... poll it once per frame and keep working in the meantime
 	{
-		queue_buffer_t* buffer = acquireBuffer();
+		return this->backend.tickets( [this]( const uint64_t ticket ) { return this->executed( ticket ); } );
+	}
+	template< typename TRep, typename TPeriod >
+	bool join_for( const std::chrono::duration< TRep, TPeriod >& timeout )							//	join(), but gives up after `timeout` ... returns false when the queue is still busy
+	{
+		return this->join_until( std::chrono::steady_clock::now() + timeout );
+	}
+	template< typename TClock, typename TDuration >
+	bool join_until( const std::chrono::time_point< TClock, TDuration >& deadline )
+	{
+		return this->backend.tickets( [&]( const uint64_t ticket ) { return this->wait_until( ticket, deadline ); } );
+	}
 
-		char* data = allocCommand( buffer, function, sizeof( T1 ) + sizeof( T2 ) + sizeof( T3 ) + sizeof( T4 ) + sizeof( T5 ) + sizeof( T6 ) );
-		*( ( T1* ) data ) = v1;
-		*( ( T2* ) ( data + sizeof( T1 ) ) ) = v2;
-		*( ( T3* ) ( data + sizeof( T1 ) + sizeof( T2 ) ) )= v3;
-		*( ( T4* ) ( data + sizeof( T1 ) + sizeof( T2 ) + sizeof( T3 ) ) )= v4;
-		*( ( T5* ) ( data + sizeof( T1 ) + sizeof( T2 ) + sizeof( T3 ) + sizeof( T4 ) ) )= v5;
-		*( ( T6* ) ( data + sizeof( T1 ) + sizeof( T2 ) + sizeof( T3 ) + sizeof( T4 ) + sizeof( T5 ) ) )= v6;
 
-		releaseBuffer( buffer );
+	//
+	//		pending()																					//	Never blocks! The number of commands published but not executed yet, by ALL threads ... a snapshot, the command thread only publishes its progress after each drain!
+	//
+	uint64_t pending()
+	{
+		return this->backend.pending();																	//	Summed over the lanes with StagingBuffers
 	}
 
 
 	//
-	//		executeWithCopy()																			//	advanced! Copies the raw data directly to the buffer! You probably won't ever need it! It allows me to write raw data to the Command Queue buffers, for example, raw TCP/UDP data packets from the network!
+	//		operator ()		functors!																	//	NOTE: If you create an object pointer out of this (with `new`), then you need to use (*objname)(function_to_call) ... note the object/pointer dereference ... it sucks I know!
 	//
-	template< typename TCB >
-	void rawExecuteWithCopy( const TCB function, const void* data, const uint32_t size )
-	{
-		queue_buffer_t* buffer = acquireBuffer();
+	template< typename F >
+	BasicCommandQueue & operator ()( F&& function ) { this->execute( std::forward< F >( function ) ); return *this; }		//	Supports ALL lambda functions now, like `[] { printf( "Hi" ); }` or `[=] { printf( "%d", i ); }` ... the lambda object is stored in the queue, it doesn't have to convert to a `function pointer` anymore!
 
-		::memcpy( allocCommand( buffer, function, size ), data, size );
+	template< typename TCB, typename T1, typename... T >
+	BasicCommandQueue & operator ()( TCB&& function, T1&& v1, T&&... v ) { this->execute( std::forward< TCB >( function ), std::forward< T1 >( v1 ), std::forward< T >( v )... ); return *this; }
 
-		releaseBuffer( buffer );
+
+	//
+	//		dropped()																					//	RingBackend< N, OverflowPolicy::Drop > only! The number of commands thrown away because the ring was full
+	//
+	uint64_t dropped()
+	{
+		return this->backend.dropped();
 	}
 
 
 	//
-	//		::SetEvent()
+	//		configured()																				//	false when the OS refused some of your CommandQueueOptions (usually SCHED_FIFO without the rights), check it before you trust a "real-time" queue!
 	//
-	#if defined(_WIN32) && defined(HANDLE)
-protected:
-	void setEvent_cb( HANDLE** ev )																		//	Very useful for Windows development! Because you can use it for general purpose event notification! But join() is probably enough ... this could however send a notification to another thread to begin execution etc. join() locks the current thread, but maybe you want the current thread to continue and notify another thread somewhere else that a task is complete! It has come in handy before!
+	bool configured() const
 	{
-		::SetEvent( *ev );
+		return this->configuredOk;
 	}
-public:
-	void setEvent( HANDLE ev )
+
+
+	//
+	//		consumerState()																				//	Draining, Spinning or Parked ... just a snapshot, it can change the moment you look at it!
+	//
+	ConsumerState consumerState()
 	{
-		this->execute( setEvent_cb, ev );
+		return this->state.load( std::memory_order_relaxed );
 	}
-	#endif
 
 
 	//
-	//		join
+	//		stats()																						//	Scrape it into your metrics system! Only `enqueued` and `executed` are counted without COMMANDQUEUE_ENABLE_STATS, the rest stay 0
 	//
-private:																								//	They are both here together for reference!
-	static void join_cb( CommandQueue* commandQ, bool* done )
+	CommandQueueStats stats()
 	{
-		*done = true;																					//	This sets the `done` bool below, via dereferenced pointer, which is read by the lambda function in the cvJoin.wait() statement below!
-		commandQ->cvJoin.notify_one();
+		CommandQueueStats result;
+		this->backend.progress( result );																//	enqueued, executed (and bytes) ... summed over the lanes with StagingBuffers
+		#if defined(COMMANDQUEUE_ENABLE_STATS)
+		result.drains = this->drains.load( std::memory_order_relaxed );
+		result.maxBatch = this->maxBatch.load( std::memory_order_relaxed );
+		result.parks = this->parks.load( std::memory_order_relaxed );
+		this->backend.stats( result );
+		#endif
+		return result;
 	}
-public:
-	void join()																							//	Man, I really don't want to have to explain how this works ... just too technical! Read about condition variables and lambdas.
+
+
+	//
+	//		latency()																					//	COMMANDQUEUE_ENABLE_LATENCY only! p50 / p99 / p999 / max in nanoseconds, since the queue was created ... from any thread
+	//
+	#if defined(COMMANDQUEUE_ENABLE_LATENCY)
+	CommandQueueLatency latency() const
 	{
-		bool done = false;
-		this->execute( join_cb, this, &done );
-		std::unique_lock<std::mutex> lock( this->mtxDequeue );
-		cvJoin.wait( lock, [&] { return done; } );														//	Condition variables can be signaled by the operating system and return randomly, so we need a way to `signal` them that they must return from OUR `done` message only, that's what the lambda function does!
-		lock.unlock();
+		CommandQueueLatency result;
+		result.queued = LatencyPercentiles( this->recorder.queued );
+		result.executed = LatencyPercentiles( this->recorder.executed );
+		return result;
 	}
+	#endif
 
 
 	//
-	//		operator ()		functors!																	//	NOTE: If you create an object pointer out of this (with `new`), then you need to use (*objname)(function_to_call) ... note the object/pointer dereference ... it sucks I know!
+	//		profile()																					//	COMMANDQUEUE_ENABLE_PROFILING only! Call count, total and max time of every function the command thread executed, most total time first ... from any thread
 	//
-//	template< typename TCB >
-//	CommandQueue & operator ()( const TCB function ) { this->execute( function ); return *this; }		//	original
-	CommandQueue & operator ()( void (*function)() ) { this->execute( function ); return *this; }		//	new - to support basic lambda functions like `[] { printf( "Hi" ); }` ... this forces the lambda to generate a `function pointer` ... the other functions cannot do this, becase lambdas cannot be templated, that's why I removed the template here! It has no values, only the `void` on return which will be common for all these functions!
+	#if defined(COMMANDQUEUE_ENABLE_PROFILING)
+	std::vector< HandlerStats > profile() const
+	{
+		return this->recorder.handlers.snapshot();
+	}
+	void printProfile( FILE* file = stdout ) const
+	{
+		const std::vector< HandlerStats > handlers = this->profile();
+		uint64_t total = 0;
+		for ( size_t i = 0; i < handlers.size(); i++ )
+			total += handlers[ i ].nanoseconds;
 
-	template< typename TCB, typename T1 >
-	CommandQueue & operator ()( const TCB function, const T1 v1 ) { this->execute( function, v1 ); return *this; }
-	template< typename TCB, typename T1, typename T2 >
-	CommandQueue & operator ()( const TCB function, const T1 v1, const T2 v2 ) { this->execute( function, v1, v2 ); return *this; }
-	template< typename TCB, typename T1, typename T2, typename T3 >
-	CommandQueue & operator ()( const TCB function, const T1 v1, const T2 v2, const T3 v3 ) { this->execute( function, v1, v2, v3 ); return *this; }
-	template< typename TCB, typename T1, typename T2, typename T3, typename T4 >
-	CommandQueue & operator ()( const TCB function, const T1 v1, const T2 v2, const T3 v3, const T4 v4 ) { this->execute( function, v1, v2, v3, v4 ); return *this; }
-	template< typename TCB, typename T1, typename T2, typename T3, typename T4, typename T5 >
-	CommandQueue & operator ()( const TCB function, const T1 v1, const T2 v2, const T3 v3, const T4 v4, const T5 v5 ) { this->execute( function, v1, v2, v3, v4, v5 ); return *this; }
-	template< typename TCB, typename T1, typename T2, typename T3, typename T4, typename T5, typename T6 >
-	CommandQueue & operator ()( const TCB function, const T1 v1, const T2 v2, const T3 v3, const T4 v4, const T5 v5, const T6 v6 ) { this->execute( function, v1, v2, v3, v4, v5, v6 ); return *this; }
+		fprintf( file, "%12s %12s %10s %10s %6s  %s\n", "calls", "total ms", "avg ns", "max ns", "time", "handler" );
+		for ( size_t i = 0; i < handlers.size(); i++ )
+		{
+			const HandlerStats& handler = handlers[ i ];
+			fprintf( file, "%12llu %12.3f %10llu %10llu %5.1f%%  %s\n", ( unsigned long long ) handler.calls, handler.nanoseconds / 1000000.0, ( unsigned long long ) ( handler.calls ? handler.nanoseconds / handler.calls : 0 ),
+				( unsigned long long ) handler.maximum, total ? 100.0 * handler.nanoseconds / total : 0.0, handler.name().c_str() );
+		}
+	}
+	#endif
 
 
 	//
@@ -711,8 +2638,16 @@ public:
 	//
 	void printBufferSizes()
 	{
-		printf( "Double Buffer sizes: %d KB + %d KB\n", this->buffer[ 0 ].size / 1024, this->buffer[ 1 ].size / 1024 );
+		this->backend.printBufferSizes();
 	}
 };
 
+
+typedef BasicCommandQueue< DoubleBuffer >	CommandQueue;											//	The original! All producers share the double buffers
+typedef BasicCommandQueue< StagingBuffers >	StagedCommandQueue;										//	One private double buffer per producer thread, for MANY producer threads hammering the same queue!
+																									//	BasicCommandQueue< RingBackend< 1048576 > > ... a fixed size 1MB ring buffer, the memory used by the queue never grows!
+																									//	BasicCommandQueue< RingBackend< 1048576, OverflowPolicy::Drop > > ... same, but drops new commands when the ring is full
+																									//	BasicCommandQueue< DoubleBuffer, BusySpin > ... the command thread never sleeps, for a dedicated core
+																									//	BasicCommandQueue< BasicDoubleBuffer< HugePageMemory< true > > > ( 64 * 1024 * 1024 ) ... 64MB buffers on locked huge pages, no TLB misses or page faults while draining
+
 #endif // __COMMAND_QUEUE_HPP__
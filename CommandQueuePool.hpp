@@ -0,0 +1,628 @@
+#ifndef __COMMAND_QUEUE_POOL_HPP__
+#define __COMMAND_QUEUE_POOL_HPP__
+
+/*
+MIT License
+
+Copyright (c) 2016 Trevor Herselman
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+Written by Trevor Herselman
+
+The Command Queue Pool runs N Command Queues (N threads) behind one object.
+Commands go to the worker with the least pending work, or are hashed by a key
+when the commands for that key must execute in order.
+
+The Work Stealing Pool gives every worker thread its own deque of commands,
+idle workers steal from the busy ones.
+*/
+
+#include <functional>
+
+#include "CommandQueue.hpp"
+
+
+template< typename TBackend = DoubleBuffer, typename TWait = SpinPark >							//	Same template parameters as BasicCommandQueue, every worker is a complete BasicCommandQueue with its own backend, thread and buffers!
+class BasicCommandQueuePool
+{
+public:
+	typedef BasicCommandQueue< TBackend, TWait > queue_t;
+
+protected:
+	queue_t**				queues;
+	uint32_t				count;
+	std::atomic< uint32_t >	next{ 0 };																	//	The first candidate of nextQueue(), so idle workers take turns
+
+
+	//
+	//		nextQueue()																					//	The less loaded of TWO workers ("power of two choices")! A worker stuck on a long command doesn't get more work piled up behind it while the others are idle, and we don't read every worker's counters for every command
+	//
+	queue_t& nextQueue()
+	{
+		const uint32_t turn = this->next.fetch_add( 1, std::memory_order_relaxed );
+		queue_t* first = this->queues[ turn % this->count ];
+		if ( this->count == 1 )
+			return *first;
+		const uint32_t skip = 1 + ( ( turn * 2654435761u ) >> 16 ) % ( this->count - 1 );			//	Any OTHER worker, scrambled so the pairs don't repeat
+		queue_t* second = this->queues[ ( turn + skip ) % this->count ];
+		return second->pending() < first->pending() ? *second : *first;							//	Never blocks, just a few loads ... a snapshot, the workers publish their progress after every drain. A tie goes to the round-robin one
+	}
+
+public:
+	BasicCommandQueuePool( const uint32_t threads = std::thread::hardware_concurrency(), const uint32_t size = 256 )	//	hardware_concurrency() can return 0 if it doesn't know, we always start at least 1 thread!
+	{
+		this->count = threads ? threads : 1;
+		this->queues = new queue_t*[ this->count ];
+		for ( uint32_t i = 0; i < this->count; i++ )
+			this->queues[ i ] = new queue_t( size );
+	}
+	~BasicCommandQueuePool()																			//	Every queue finishes its own commands and stops its thread, same as ~BasicCommandQueue()
+	{
+		for ( uint32_t i = 0; i < this->count; i++ )
+			delete this->queues[ i ];
+		delete[] this->queues;
+	}
+	BasicCommandQueuePool( const BasicCommandQueuePool& ) = delete;
+	BasicCommandQueuePool& operator =( const BasicCommandQueuePool& ) = delete;
+
+
+	//
+	//		execute()																					//	Unordered! The next command can run on another thread BEFORE this one, use byKey() when the order matters!
+	//
+	template< typename F, typename... T >
+	void execute( F&& function, T&&... v )
+	{
+		this->nextQueue().execute( std::forward< F >( function ), std::forward< T >( v )... );
+	}
+	template< typename F, typename... T >
+	bool try_execute( F&& function, T&&... v )
+	{
+		return this->nextQueue().try_execute( std::forward< F >( function ), std::forward< T >( v )... );
+	}
+	template< typename F, typename... T >
+	auto async( F&& function, T&&... v ) -> decltype( std::declval< queue_t& >().async( std::forward< F >( function ), std::forward< T >( v )... ) )
+	{
+		return this->nextQueue().async( std::forward< F >( function ), std::forward< T >( v )... );
+	}
+
+
+	//
+	//		byKey()																						//	All the commands for the same key go to the same worker thread, so they execute in order! Different keys still run in parallel ... pool.byKey( playerId ).execute( cmdMove, x, y );
+	//
+	template< typename K >
+	queue_t& byKey( const K& key )
+	{
+		return *this->queues[ std::hash< K >()( key ) % this->count ];
+	}
+
+
+	//
+	//		join()																						//	Waits for the commands on ALL the worker threads
+	//
+	void join()
+	{
+		for ( uint32_t i = 0; i < this->count; i++ )
+			this->queues[ i ]->join();
+	}
+
+
+	uint32_t size() const { return this->count; }														//	Number of worker threads
+	queue_t& operator []( const uint32_t index ) { return *this->queues[ index ]; }				//	Direct access to a worker queue
+
+
+	void printBufferSizes()
+	{
+		for ( uint32_t i = 0; i < this->count; i++ )
+			this->queues[ i ]->printBufferSizes();
+	}
+};
+
+
+//
+//		WorkStealingPool																			//	N worker threads, every worker owns a Chase-Lev deque of commands. Commands added by a worker go to its OWN deque (no contention), idle workers steal from the other end of the other deques, so a fan-out of CPU bound work spreads over all the cores!
+//
+template< typename TWait = SpinPark, typename TMemory = HeapMemory >								//	Only `spins` and `yields` of TWait are used, the workers always park when there is nothing to steal ... the tasks come from TMemory::allocateNode()
+class BasicWorkStealingPool																			//	NOTE: Unordered! Use BasicCommandQueuePool::byKey() when the order matters
+{
+protected:
+	//
+	//		task_t																						//	One command in a fixed size block, the command itself uses the SAME record format as allocCommand(): { stub, size, data } ... and it's executed with executeCommands()!
+	//
+	struct alignas( COMMAND_ALIGNMENT ) task_t															//	Padded to COMMAND_ALIGNMENT, so the command behind it is aligned exactly like a command in the queue buffers
+	{
+		task_t*				next;																		//	Free list and injection queue
+		char*				command()	{ return ( char* ) ( this + 1 ); }
+		uint32_t			size()		{ return *( ( uint32_t* ) ( this->command() + sizeof( PFNCommandHandler* ) ) ); }
+	};
+	static const uint32_t	BLOCK = sizeof( task_t ) + 128;												//	Block size, including task_t ... most commands are a stub + a function pointer + a few parameters! Bigger commands are allocated on their own
+
+	struct cache_t																						//	Per thread free list of blocks, no locks! Blocks are returned to the cache of the thread that executed them, so the workers recycle their own blocks
+	{
+		task_t*				free = nullptr;
+		uint32_t			count = 0;
+
+		~cache_t()
+		{
+			while ( this->free )
+			{
+				task_t* next = this->free->next;
+				TMemory::deallocateNode( this->free, BLOCK );
+				this->free = next;
+			}
+		}
+	};
+	static cache_t& cache()
+	{
+		static thread_local cache_t cache;
+		return cache;
+	}
+	static task_t* allocTask( const uint32_t reserved )
+	{
+		if ( sizeof( task_t ) + reserved > BLOCK )
+			return ( task_t* ) TMemory::allocateNode( sizeof( task_t ) + reserved );
+		cache_t& cache = BasicWorkStealingPool::cache();
+		task_t* task = cache.free;
+		if ( task == nullptr )
+			return ( task_t* ) TMemory::allocateNode( BLOCK );
+		cache.free = task->next;
+		cache.count--;
+		return task;
+	}
+	static void freeTask( task_t* task )
+	{
+		cache_t& cache = BasicWorkStealingPool::cache();
+		const uint32_t size = sizeof( task_t ) + task->size();
+		if ( size > BLOCK || cache.count >= 1024 )														//	Don't hoard blocks, a worker that only executes (and never adds) would keep them all!
+		{
+			TMemory::deallocateNode( task, size > BLOCK ? size : BLOCK );
+			return;
+		}
+		task->next = cache.free;
+		cache.free = task;
+		cache.count++;
+	}
+
+
+	//
+	//		deque_t																						//	Chase-Lev work-stealing deque (the C11 version by Le, Pop, Cohen & Zappa Nardelli), fixed size! The owner pushes and pops at the `bottom`, thieves steal from the `top`
+	//
+	struct deque_t
+	{
+		static const int64_t			CAPACITY = 4096;												//	Power of two! When it's full, push() fails and the command goes to the injection queue
+		static const int64_t			MASK = CAPACITY - 1;
+
+		std::atomic< int64_t >			top{ 0 };														//	Thieves side
+		char							padTop[ CACHE_LINE ];
+		std::atomic< int64_t >			bottom{ 0 };													//	Owner side ... every push() and pop() writes it, don't make the thieves pay for that!
+		char							padBottom[ CACHE_LINE ];
+		std::atomic< task_t* >			tasks[ CAPACITY ];
+
+		bool push( task_t* task )																		//	owner only!
+		{
+			const int64_t b = this->bottom.load( std::memory_order_relaxed );
+			const int64_t t = this->top.load( std::memory_order_acquire );
+			if ( b - t >= CAPACITY )
+				return false;
+			this->tasks[ b & MASK ].store( task, std::memory_order_relaxed );
+			this->bottom.store( b + 1, std::memory_order_release );									//	Publishes the command to the thieves, they load `bottom` with acquire
+			return true;
+		}
+		task_t* pop()																					//	owner only! LIFO, the newest command is still hot in the cache
+		{
+			const int64_t b = this->bottom.load( std::memory_order_relaxed ) - 1;
+			this->bottom.store( b, std::memory_order_relaxed );
+			std::atomic_thread_fence( std::memory_order_seq_cst );
+			int64_t t = this->top.load( std::memory_order_relaxed );
+			if ( t > b )																				//	empty
+			{
+				this->bottom.store( b + 1, std::memory_order_relaxed );
+				return nullptr;
+			}
+			task_t* task = this->tasks[ b & MASK ].load( std::memory_order_relaxed );
+			if ( t == b )																				//	the last one, race the thieves for it!
+			{
+				if ( !this->top.compare_exchange_strong( t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed ) )
+					task = nullptr;
+				this->bottom.store( b + 1, std::memory_order_relaxed );
+			}
+			return task;
+		}
+		task_t* steal()																					//	any thread! FIFO, the oldest command
+		{
+			int64_t t = this->top.load( std::memory_order_acquire );
+			std::atomic_thread_fence( std::memory_order_seq_cst );
+			const int64_t b = this->bottom.load( std::memory_order_acquire );
+			if ( t >= b )
+				return nullptr;
+			task_t* task = this->tasks[ t & MASK ].load( std::memory_order_relaxed );
+			if ( !this->top.compare_exchange_strong( t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed ) )
+				return nullptr;																			//	lost the race against the owner or another thief
+			return task;
+		}
+		bool empty() const
+		{
+			return this->top.load( std::memory_order_acquire ) >= this->bottom.load( std::memory_order_acquire );
+		}
+	};
+
+	struct worker_t
+	{
+		deque_t					deque;
+		std::thread*			hThread;
+		uint32_t				turns = 0;																//	Only touched by the worker itself, see find()
+	};
+
+	struct current_t																					//	Which worker (of which pool) is the current thread? So execute() from inside a command goes to the local deque!
+	{
+		BasicWorkStealingPool*	pool;
+		uint32_t				index;
+	};
+	static current_t& current()
+	{
+		static thread_local current_t current = { nullptr, 0 };
+		return current;
+	}
+
+	worker_t*					workers;
+	uint32_t					count;
+
+	std::mutex					mtxInject;																//	Injection queue, for commands added by threads that are NOT workers of this pool, or when the local deque is full
+	task_t*						injectHead = nullptr;
+	task_t*						injectTail = nullptr;
+	std::atomic< uint32_t >		injected{ 0 };															//	So the workers don't lock mtxInject just to see that it's empty!
+
+	std::mutex					mtxPark;
+	std::condition_variable		cvPark;
+	std::atomic< uint32_t >		sleepers{ 0 };															//	Number of parked workers, producers only lock + notify when this isn't 0
+	std::atomic< uint32_t >		epoch{ 0 };																//	Changed (under the lock) by every wake up
+	std::atomic< bool >			shutdown{ false };
+	char						padShared[ CACHE_LINE ];												//	`sleepers` and `injected` are read by every execute(), `pending` is WRITTEN by every execute() and every command ... keep them apart!
+
+	std::mutex					mtxJoin;
+	std::condition_variable		cvJoin;
+	std::atomic< uint64_t >		pending{ 0 };															//	Commands added but not executed yet, join() waits for 0
+	std::atomic< uint32_t >		joiners{ 0 };
+
+
+	//
+	//		submit()
+	//
+	void submit( task_t* task, const bool local = true )											//	local = false: straight to the back of the injection queue, behind everything that is already waiting ... see Strand::drain()
+	{
+		this->pending.fetch_add( 1, std::memory_order_relaxed );
+
+		current_t& current = BasicWorkStealingPool::current();
+		if ( !local || current.pool != this || !this->workers[ current.index ].deque.push( task ) )
+		{
+			std::lock_guard<std::mutex> lock( this->mtxInject );
+			task->next = nullptr;
+			if ( this->injectTail )
+				this->injectTail->next = task;
+			else
+				this->injectHead = task;
+			this->injectTail = task;
+			this->injected.fetch_add( 1, std::memory_order_release );
+		}
+
+		std::atomic_thread_fence( std::memory_order_seq_cst );										//	Pairs with the fence in park() ... either the worker sees our command, or we see the worker
+		if ( this->sleepers.load( std::memory_order_relaxed ) )
+		{
+			{
+				std::lock_guard<std::mutex> lock( this->mtxPark );
+				this->epoch.fetch_add( 1, std::memory_order_relaxed );
+			}
+			this->cvPark.notify_one();
+		}
+	}
+
+
+	//
+	//		find()																						//	Local deque first, then the injection queue, then steal from the other workers ... but every INJECT_TURN'th time the injection queue goes first, so a worker that keeps refilling its own deque can't starve it!
+	//
+	static const uint32_t INJECT_TURN = 32;
+
+	task_t* inject()
+	{
+		if ( !this->injected.load( std::memory_order_acquire ) )
+			return nullptr;
+		std::lock_guard<std::mutex> lock( this->mtxInject );
+		task_t* task = this->injectHead;
+		if ( task )
+		{
+			this->injectHead = task->next;
+			if ( this->injectHead == nullptr )
+				this->injectTail = nullptr;
+			this->injected.fetch_sub( 1, std::memory_order_relaxed );
+		}
+		return task;
+	}
+	task_t* find( const uint32_t index )
+	{
+		worker_t& worker = this->workers[ index ];
+		task_t* task;
+		if ( ++worker.turns % INJECT_TURN == 0 && ( task = this->inject() ) != nullptr )
+			return task;
+
+		task = worker.deque.pop();
+		if ( task )
+			return task;
+
+		task = this->inject();
+		if ( task )
+			return task;
+
+		for ( uint32_t i = 1; i < this->count; i++ )													//	Start with our neighbour, so the thieves don't all gang up on worker 0!
+		{
+			task = this->workers[ ( index + i ) % this->count ].deque.steal();
+			if ( task )
+				return task;
+		}
+		return nullptr;
+	}
+	bool hasWork()
+	{
+		if ( this->injected.load( std::memory_order_acquire ) )
+			return true;
+		for ( uint32_t i = 0; i < this->count; i++ )
+			if ( !this->workers[ i ].deque.empty() )
+				return true;
+		return false;
+	}
+
+
+	//
+	//		makeTask()																					//	Writes the command into a new block, exactly like allocCommand() + enqueue() do in the queue buffer
+	//
+	template< typename F, typename... T >
+	static task_t* makeTask( F&& function, T&&... v )
+	{
+		typedef args_layout_t< 0, typename std::decay< F >::type, typename std::decay< T >::type... > layout_t;
+		const PFNCommandHandler stub = ( PFNCommandHandler ) executeStub< typename std::decay< F >::type, typename std::decay< T >::type... >;
+		const uint32_t reserved = commandSize( layout_t::size );
+
+		task_t* task = allocTask( reserved );
+		char* command = task->command();
+		*( ( PFNCommandHandler* ) command ) = stub;														//	Same as allocCommand()
+		*( ( uint32_t* ) ( command + sizeof( PFNCommandHandler* ) ) ) = reserved;
+		layout_t::construct( command + COMMAND_HEADER, std::forward< F >( function ), std::forward< T >( v )... );
+		return task;
+	}
+
+
+	//
+	//		run()
+	//
+	static void run( task_t* task )
+	{
+		char* command = task->command();
+		executeCommands( command, command + task->size() );											//	Exactly ONE command
+		freeTask( task );
+	}
+	void completed( const uint64_t executed )															//	`executed` commands are done, wakes up join() when that was the last of them
+	{
+		if ( this->pending.fetch_sub( executed ) == executed && this->joiners.load() )				//	seq_cst! Pairs with join()
+		{
+			std::lock_guard<std::mutex> lock( this->mtxJoin );
+			this->cvJoin.notify_all();
+		}
+	}
+
+
+	//
+	//		park()
+	//
+	void park()
+	{
+		this->sleepers.fetch_add( 1 );
+		const uint32_t epoch = this->epoch.load( std::memory_order_relaxed );
+		std::atomic_thread_fence( std::memory_order_seq_cst );
+		if ( !this->hasWork() && !this->shutdown )
+		{
+			std::unique_lock<std::mutex> lock( this->mtxPark );
+			this->cvPark.wait( lock, [&] { return this->epoch.load( std::memory_order_relaxed ) != epoch || this->shutdown; } );
+		}
+		this->sleepers.fetch_sub( 1, std::memory_order_relaxed );
+	}
+
+
+	//
+	//		thread()
+	//
+	void thread( const uint32_t index )
+	{
+		current_t& current = BasicWorkStealingPool::current();
+		current.pool = this;
+		current.index = index;
+
+		uint32_t idle = 0;
+		while ( true )
+		{
+			task_t* task = this->find( index );
+			if ( task )
+			{
+				run( task );
+				this->completed( 1 );
+				idle = 0;
+			}
+			else if ( this->shutdown )
+				break;
+			else if ( idle < TWait::spins )
+			{
+				idle++;
+				cpuRelax();
+			}
+			else if ( idle - TWait::spins < TWait::yields )
+			{
+				idle++;
+				std::this_thread::yield();
+			}
+			else
+			{
+				this->park();
+				idle = 0;
+			}
+		}
+
+		current.pool = nullptr;
+	}
+
+public:
+	BasicWorkStealingPool( const uint32_t threads = std::thread::hardware_concurrency() )
+	{
+		this->count = threads ? threads : 1;
+		this->workers = new worker_t[ this->count ];
+		for ( uint32_t i = 0; i < this->count; i++ )
+			this->workers[ i ].hThread = new std::thread( &BasicWorkStealingPool::thread, this, i );
+	}
+	~BasicWorkStealingPool()
+	{
+		this->join();
+		{
+			std::lock_guard<std::mutex> lock( this->mtxPark );
+			this->shutdown = true;
+		}
+		this->cvPark.notify_all();
+		for ( uint32_t i = 0; i < this->count; i++ )
+		{
+			this->workers[ i ].hThread->join();
+			delete this->workers[ i ].hThread;
+		}
+		delete[] this->workers;
+	}
+	BasicWorkStealingPool( const BasicWorkStealingPool& ) = delete;
+	BasicWorkStealingPool& operator =( const BasicWorkStealingPool& ) = delete;
+
+
+	//
+	//		execute()																					//	Same as BasicCommandQueue::execute() ... functions, lambdas with captures, any parameters, moved into the block!
+	//
+	template< typename F, typename... T >
+	void execute( F&& function, T&&... v )
+	{
+		this->submit( makeTask( std::forward< F >( function ), std::forward< T >( v )... ) );
+	}
+
+
+	//
+	//		join()																						//	Waits until EVERY command has executed, including the commands added by other commands! NEVER call it from a worker thread
+	//
+	void join()
+	{
+		assert( BasicWorkStealingPool::current().pool != this );
+		this->joiners.fetch_add( 1 );
+		{
+			std::unique_lock<std::mutex> lock( this->mtxJoin );
+			this->cvJoin.wait( lock, [this] { return this->pending.load() == 0; } );
+		}
+		this->joiners.fetch_sub( 1 );
+	}
+
+
+	uint32_t size() const { return this->count; }														//	Number of worker threads
+
+
+	//
+	//		Strand																						//	A logical CommandQueue on the shared pool! The commands of ONE strand execute in order, one at a time, but thousands of strands only need the worker threads of the pool ... no thread (and no context switch) per strand!
+	//
+	class Strand																						//	WorkStealingPool::Strand player( pool ); player.execute( cmdMove, x, y );
+	{
+		static const uint32_t	BATCH = 64;																//	Max commands per turn on a worker, then the strand goes to the back of the injection queue, so one busy strand can't hog a worker!
+
+		BasicWorkStealingPool&	pool;
+		std::mutex				mtx;																	//	Only protects the list, never held while a command executes
+		task_t*					head = nullptr;
+		task_t*					tail = nullptr;
+		std::atomic< uint32_t >	count{ 0 };																//	Commands in the list + the one executing ... whoever changes it from 0 to 1 schedules the strand on the pool!
+
+		static void drain( Strand* strand )																//	Runs on a worker, and never on 2 workers at the same time, because the strand is only rescheduled by the previous turn!
+		{
+			uint32_t executed = 0;
+			while ( executed < BATCH )
+			{
+				task_t* task;
+				{
+					std::lock_guard<std::mutex> lock( strand->mtx );
+					task = strand->head;
+					if ( task == nullptr )
+						break;
+					strand->head = task->next;
+					if ( strand->head == nullptr )
+						strand->tail = nullptr;
+				}
+				run( task );
+				executed++;
+			}
+			BasicWorkStealingPool& pool = strand->pool;
+			if ( strand->count.fetch_sub( executed ) != executed )										//	More commands arrived while we were busy, take another turn ... LATER! NOT on our own deque, pop() is LIFO, we would be the very next command again
+				pool.submit( makeTask( drain, strand ), false );
+			else if ( pool.joiners.load() )																//	The strand is idle, and might be destroyed by its join() the moment it sees `count` == 0, so we don't touch it anymore!
+			{
+				std::lock_guard<std::mutex> lock( pool.mtxJoin );
+				pool.cvJoin.notify_all();
+			}
+			pool.completed( executed );																	//	AFTER the reschedule, or join() could see 0 pending while the strand still has commands!
+		}
+
+	public:
+		Strand( BasicWorkStealingPool& pool ) : pool( pool ) {}
+		~Strand() { this->join(); }
+		Strand( const Strand& ) = delete;
+		Strand& operator =( const Strand& ) = delete;
+
+		template< typename F, typename... T >
+		void execute( F&& function, T&&... v )
+		{
+			task_t* task = makeTask( std::forward< F >( function ), std::forward< T >( v )... );
+			task->next = nullptr;
+			this->pool.pending.fetch_add( 1, std::memory_order_relaxed );								//	So pool.join() waits for the strands too
+			uint32_t before;
+			{
+				std::lock_guard<std::mutex> lock( this->mtx );
+				if ( this->tail )
+					this->tail->next = task;
+				else
+					this->head = task;
+				this->tail = task;
+				before = this->count.fetch_add( 1, std::memory_order_acq_rel );						//	Under the lock, so drain() can never take more commands than it subtracts!
+			}
+			if ( before == 0 )
+				this->pool.execute( drain, this );
+		}
+		template< typename F, typename... T >
+		Strand& operator ()( F&& function, T&&... v ) { this->execute( std::forward< F >( function ), std::forward< T >( v )... ); return *this; }
+
+		void join()																						//	Waits until THIS strand has no commands left, NEVER call it from a command on the pool
+		{
+			BasicWorkStealingPool& pool = this->pool;
+			pool.joiners.fetch_add( 1 );																//	seq_cst! Pairs with the `count` check in drain()
+			{
+				std::unique_lock<std::mutex> lock( pool.mtxJoin );
+				pool.cvJoin.wait( lock, [this] { return this->count.load() == 0; } );
+			}
+			pool.joiners.fetch_sub( 1 );
+		}
+	};
+};
+
+
+typedef BasicCommandQueuePool< DoubleBuffer >	CommandQueuePool;
+typedef BasicWorkStealingPool<>				WorkStealingPool;
+
+#endif // __COMMAND_QUEUE_POOL_HPP__
@@ -47,6 +47,115 @@ void doWork()
 	calls++;																				//	Just giving it something to do
 }
 
+
+//
+//		benchEnqueue()																		//	Times ONLY the producer side, execute() in a loop, so you can see what the wake up of the command thread costs the producer!
+//
+template< typename TCommandQueue >
+void benchEnqueue( const char* name, const int count )
+{
+	calls = 0;
+	TCommandQueue* commandQ = new TCommandQueue();
+
+	auto start = std::chrono::steady_clock::now();
+	for ( int i = 0; i < count; i++ )
+		commandQ->execute( doWork );
+	auto end = std::chrono::steady_clock::now();
+
+	commandQ->join();
+	delete commandQ;
+
+	std::chrono::steady_clock::duration time_span = end - start;
+	double diff = double(time_span.count()) * std::chrono::steady_clock::period::num / std::chrono::steady_clock::period::den;
+	printf( "%-40s %f sec   %6.2f ns per execute()   Function calls: %d\n", name, diff, diff * 1e9 / count, calls );
+}
+
+
+//
+//		benchDrain()																		//	Times ONLY the command thread! The first command holds the gate closed until the producer has queued everything, so we measure a pure drain of `count` records with mixed alignment arguments
+//
+std::atomic< bool > gate;
+double sum = 0;
+
+void doMixedWork( char c, double d, uint64_t u )
+{
+	sum += c + d + u;																		//	`d` and `u` are 8-byte aligned inside the record, the `char` in front of them is padded out!
+}
+
+void benchDrain( const int count )
+{
+	CommandQueue* commandQ = new CommandQueue();
+	gate = false;
+	sum = 0;
+
+	commandQ->execute( []() { while ( !gate.load( std::memory_order_acquire ) ) std::this_thread::yield(); } );
+	for ( int i = 0; i < count; i++ )
+		commandQ->execute( doMixedWork, 'a', 1.0, (uint64_t) i );
+
+	auto start = std::chrono::steady_clock::now();
+	gate.store( true, std::memory_order_release );
+	commandQ->join();
+	auto end = std::chrono::steady_clock::now();
+	delete commandQ;
+
+	std::chrono::steady_clock::duration time_span = end - start;
+	double diff = double(time_span.count()) * std::chrono::steady_clock::period::num / std::chrono::steady_clock::period::den;
+	printf( "%u-byte records: %f sec   %6.2f ns per command   (%g)\n", COMMAND_ALIGNMENT, diff, diff * 1e9 / count, sum );
+}
+
+
+//
+//		benchJoin()																			//	Round trip: execute() one command and wait for it, the latency your thread sees when it needs the result NOW
+//
+void benchJoin( const int count )
+{
+	CommandQueue* commandQ = new CommandQueue();
+
+	auto start = std::chrono::steady_clock::now();
+	for ( int i = 0; i < count; i++ )
+	{
+		commandQ->execute( doWork );
+		commandQ->join();
+	}
+	auto middle = std::chrono::steady_clock::now();
+	for ( int i = 0; i < count; i++ )
+		commandQ->wait_until( commandQ->execute( doWork ) );								//	Same thing with a ticket, waits for THIS command only
+	auto end = std::chrono::steady_clock::now();
+	delete commandQ;
+
+	std::chrono::steady_clock::duration joins = middle - start, tickets = end - middle;
+	printf( "execute() + join():       %8.2f us per round trip\n", double( joins.count() ) * std::chrono::steady_clock::period::num / std::chrono::steady_clock::period::den * 1e6 / count );
+	printf( "execute() + wait_until(): %8.2f us per round trip\n", double( tickets.count() ) * std::chrono::steady_clock::period::num / std::chrono::steady_clock::period::den * 1e6 / count );
+}
+
+
+//
+//		benchProducers()																	//	`threads` producers hammering ONE queue while the command thread drains it ... this is where false sharing between the producer side and the consumer side of the queue hurts the most!
+//
+template< typename TCommandQueue >
+void benchProducers( const char* name, const int threads, const int count )
+{
+	TCommandQueue* commandQ = new TCommandQueue();
+	std::atomic< uint32_t > executed{ 0 };
+
+	auto start = std::chrono::steady_clock::now();
+	std::thread* producers[ 16 ];
+	for ( int t = 0; t < threads; t++ )
+		producers[ t ] = new std::thread( [&]() { for ( int i = 0; i < count; i++ ) commandQ->execute( []( std::atomic< uint32_t >* executed ) { executed->fetch_add( 1, std::memory_order_relaxed ); }, &executed ); } );
+	for ( int t = 0; t < threads; t++ )
+	{
+		producers[ t ]->join();
+		delete producers[ t ];
+	}
+	commandQ->join();
+	auto end = std::chrono::steady_clock::now();
+	delete commandQ;
+
+	std::chrono::steady_clock::duration time_span = end - start;
+	double diff = double(time_span.count()) * std::chrono::steady_clock::period::num / std::chrono::steady_clock::period::den;
+	printf( "%-16s %d producers: %f sec   %6.2f ns per command   Function calls: %u\n", name, threads, diff, diff * 1e9 / ( (double) threads * count ), executed.load() );
+}
+
 int main()
 {
 	printf( "WARNING: To be fair, don't run this from inside the Visual Studio IDE!\nstd::thread will run about 10x slower! (hooks?)\nCompile and run from executable to be fair!\n\n" );
@@ -77,6 +186,47 @@ int main()
 	calls = 0;	//	reset calls counter
 
 
+	//
+	//		Wake up Benchmark																	//	Blocking is the old behaviour, the producer locks the mutex and calls notify_one() after EVERY command! SpinPark only wakes the command thread when it is actually parked, that's the default!
+	//
+	printf( "\n... running wake up benchmark, please wait ...\n" );
+
+	benchEnqueue< BasicCommandQueue< DoubleBuffer, Blocking > >( "Blocking (notify every command)", 10000000 );
+	benchEnqueue< BasicCommandQueue< DoubleBuffer, SpinPark > >( "SpinPark (notify only when parked)", 10000000 );
+	benchEnqueue< BasicCommandQueue< DoubleBuffer, BusySpin > >( "BusySpin (never notify)", 10000000 );
+
+
+	calls = 0;	//	reset calls counter
+
+
+	//
+	//		Drain Benchmark																		//	Recompile with -DCOMMANDQUEUE_RECORD_ALIGNMENT=64 and run it again to compare cache-line aligned records against the default 16!
+	//
+	printf( "\n... running drain benchmark, please wait ...\n" );
+
+	benchDrain( 10000000 );
+
+
+	//
+	//		Join Benchmark
+	//
+	printf( "\n... running join benchmark, please wait ...\n" );
+
+	benchJoin( 100000 );
+
+
+	//
+	//		Producers Benchmark																	//	Recompile with -DCOMMANDQUEUE_CACHE_LINE=1 to squash the padding between the producer and consumer fields, and compare! `perf stat -e cache-misses` shows the coherence traffic directly
+	//
+	printf( "\n... running producers benchmark, %u-byte cache line padding, please wait ...\n", (uint32_t) CACHE_LINE );
+
+	for ( int threads = 1; threads <= 4; threads *= 2 )
+	{
+		benchProducers< CommandQueue >( "DoubleBuffer", threads, 2000000 );
+		benchProducers< BasicCommandQueue< RingBackend< 1048576 > > >( "RingBackend 1MB", threads, 2000000 );
+	}
+
+
 	//
 	//		std::thread Benchmark															//	This is a bit unfair! Because the Command Queue doesn't constantly create new threads ... but that's the whole point!!! Why create and destroy threads!?!? They are SUPER costly! And that's what I want to show you! In the time it takes you to create a new std::thread, I can execute 500+ function calls! std::thread isn't a silver bullet for parallelism! You need to consider what you are doing carefully! And BENCHMARK!
 	//
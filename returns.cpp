@@ -147,6 +147,18 @@ int main()
 	commandQ.join();
 	printf( "%d\n", r );
 
+
+	//
+	//		async() ... no return pointer and no join(), you only wait for YOUR result!
+	//
+	auto sum = commandQ.async( add2, 1, 2 );
+	//	do other work
+	printf( "%d\n", sum.get() );
+
+	auto chain = commandQ.async( add3, 1, 2, 3 ).then( inc ).then( []( int a ) { printf( "%d\n", a ); } );	//	then() runs on the command thread, directly after the previous command
+	//	do other work
+	chain.wait();
+
 	getchar();
 	return 0;
 }